@@ -14,26 +14,26 @@ namespace cyber
         return file_size;
     }
 
-    HTTPStringBody::HTTPStringBody(const std::string &str)
+    HTTPStringBody::HTTPStringBody(std::string str)
     {
-        str_ = str;
+        str_ = std::make_shared<BufferString>(std::move(str));
     }
     ssize_t HTTPStringBody::RemainSize()
     {
-        return str_.size() - offset_;
+        return str_->Size() - offset_;
     }
 
     Buffer::Ptr HTTPStringBody::ReadData(size_t size)
     {
-        size = std::min((size_t)RemainSize(), str_.size());
+        // a slice costs nothing, the rest goes out at once whatever size asks for
+        size = RemainSize();
         if (!size)
         {
             return nullptr;
         }
-        BufferRaw::Ptr ret = BufferRaw::Create();
-        ret->Assign(str_.substr(offset_, size).data(), size);
+        auto ret = std::make_shared<BufferSlice>(str_, offset_, size);
         offset_ += size;
-        return ret;
+        return std::move(ret);
     }
 
     HTTPFileBody::HTTPFileBody(const std::shared_ptr<std::ifstream> &file, size_t offset, size_t max_size)
@@ -28,15 +28,16 @@ namespace cyber
 
     public:
         typedef std::shared_ptr<HTTPStringBody> Ptr;
-        HTTPStringBody(const std::string &str);
+        HTTPStringBody(std::string str);
         virtual ~HTTPStringBody() {}
         ssize_t RemainSize() override;
+        // slices of the body string, nothing is copied
         Buffer::Ptr ReadData(size_t size) override;
 
     private:
         /* data */
         size_t offset_ = 0;
-        mutable std::string str_;
+        Buffer::Ptr str_;
     };
 
     class HTTPFileBody : public HTTPBody
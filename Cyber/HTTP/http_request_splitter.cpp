@@ -1,84 +1,142 @@
 #if !defined(CYBER_HTTP_REQUEST_SPLITTER_CPP)
 #define CYBER_HTTP_REQUEST_SPLITTER_CPP
+#include <algorithm>
 #include "http_request_splitter.h"
 #include "../Util/logger.h"
 #include "../Util/util.h"
 
+// a header split across reads is rebuilt this many bytes at a time, so little of the body behind it is copied
+#define HEADER_PROBE_SIZE 4096
+
 namespace cyber
 {
     void HTTPRequestSplitter::Input(const char *data, size_t len)
     {
-        const char *ptr = data;
-        if (!remain_data_.Empty())
-        {
-            remain_data_.Append(data, len);
-            data = ptr = remain_data_.Data();
-            len = remain_data_.Size();
-        }
-    SPLITPACKET:
+        Split(nullptr, data, len);
+    }
 
-        char &tail_ref = ((char *)ptr)[len];
-        char tail_tmp = tail_ref;
-        tail_ref = 0;
+    void HTTPRequestSplitter::Input(const Buffer::Ptr &buf, bool keep)
+    {
+        Split(keep ? buf : nullptr, buf->Data(), buf->Size());
+    }
 
-        const char *index = nullptr;
-        remain_data_size_ = len;
+    void HTTPRequestSplitter::Split(const Buffer::Ptr &buf, const char *ptr, size_t len)
+    {
+        while (len > 0)
+        {
+            if (content_len_ == 0)
+            {
+                auto used = SplitHeader(ptr, len);
+                ptr += used;
+                len -= used;
+                continue;
+            }
+            if (content_len_ < 0)
+            {
+                // no length given, everything that follows is content
+                OnRecvContent(ptr, len);
+                return;
+            }
+            size_t need = content_len_ - content_.Size();
+            if (len < need)
+            {
+                Hold(buf, ptr, len);
+                return;
+            }
+            if (content_.Empty())
+            {
+                OnRecvContent(ptr, need);
+            }
+            else
+            {
+                Hold(buf, ptr, need);
+                BufferChain content = std::move(content_);
+                content_.Clear();
+                OnRecvContentV(content);
+            }
+            ptr += need;
+            len -= need;
+            content_len_ = 0;
+        }
+    }
 
-        while (content_len_ == 0 && remain_data_size_ > 0 && (index = OnSearchPacketTail(ptr, remain_data_size_)) != nullptr)
+    size_t HTTPRequestSplitter::SplitHeader(const char *ptr, size_t len)
+    {
+        if (header_.empty())
         {
-            if (index == ptr)
+            char &tail_ref = ((char *)ptr)[len];
+            char tail_tmp = tail_ref;
+            tail_ref = 0;
+            auto index = OnSearchPacketTail(ptr, len);
+            if (index == nullptr || index == ptr)
             {
-                break;
+                tail_ref = tail_tmp;
+                header_.assign(ptr, len);
+                return len;
             }
-            if (index < ptr || index > ptr + remain_data_size_)
+            if (index < ptr || index > ptr + len)
             {
+                tail_ref = tail_tmp;
                 throw std::out_of_range("splitter error");
             }
-            const char *header_ptr = ptr;
-            ssize_t header_size = index - ptr;
-            ptr = index;
-            remain_data_size_ = len - (ptr - data);
-            content_len_ = OnRecvHeader(header_ptr, header_size);
+            content_len_ = OnRecvHeader(ptr, index - ptr);
+            tail_ref = tail_tmp;
+            return index - ptr;
         }
-        if (remain_data_size_ <= 0)
+
+        // the start of the header came earlier: append to it until its tail shows up
+        size_t old = header_.size();
+        size_t taken = 0;
+        const char *index = nullptr;
+        while (taken < len)
         {
-            remain_data_.Clear();
-            return;
+            auto n = std::min(len - taken, (size_t)HEADER_PROBE_SIZE);
+            header_.append(ptr + taken, n);
+            taken += n;
+            index = OnSearchPacketTail(header_.data(), header_.size());
+            if (index != nullptr && index != header_.data())
+            {
+                break;
+            }
+            index = nullptr;
         }
+        if (index == nullptr)
+        {
+            return len;
+        }
+        size_t header_size = index - header_.data();
+        if (header_size <= old || header_size > header_.size())
+        {
+            throw std::out_of_range("splitter error");
+        }
+        // what follows the header is parsed from the input again, not from the copy
+        std::string header;
+        header.swap(header_);
+        header.resize(header_size);
+        content_len_ = OnRecvHeader(header.data(), header_size);
+        return header_size - old;
+    }
 
-        tail_ref = tail_tmp;
-
-        if (content_len_ == 0)
+    void HTTPRequestSplitter::Hold(const Buffer::Ptr &buf, const char *ptr, size_t len)
+    {
+        if (buf)
         {
-            remain_data_.Assign(ptr, remain_data_size_);
+            content_.Append(buf, ptr - buf->Data(), len);
             return;
         }
+        content_.Append(ptr, len);
+    }
 
-        if (content_len_ > 0)
+    void HTTPRequestSplitter::OnRecvContentV(const BufferChain &content)
+    {
+        if (content.Count() == 1)
         {
-            if (remain_data_size_ < (size_t)content_len_)
-            {
-                remain_data_.Assign(ptr, remain_data_size_);
-                return;
-            }
-            OnRecvContent(ptr, content_len_);
-
-            remain_data_size_ -= content_len_;
-            ptr += content_len_;
-            content_len_ = 0;
-
-            if (remain_data_size_ > 0)
-            {
-                remain_data_.Assign(ptr, remain_data_size_);
-                data = ptr = (char *)remain_data_.Data();
-                len = remain_data_.Size();
-                goto SPLITPACKET;
-            }
-            remain_data_.Clear();
+            content.ForEach([this](const char *data, size_t len)
+                            { OnRecvContent(data, len); });
             return;
         }
-        OnRecvContent(ptr, remain_data_size_);
-        remain_data_.Clear();
+        auto str = content.ToString();
+        OnRecvContent(str.data(), str.size());
     }
 
     void HTTPRequestSplitter::SetContentLen(ssize_t content_len)
@@ -89,8 +147,8 @@ namespace cyber
     void HTTPRequestSplitter::Reset()
     {
         content_len_ = 0;
-        remain_data_size_ = 0;
-        remain_data_.Clear();
+        header_.clear();
+        content_.Clear();
     }
 
     const char *HTTPRequestSplitter::OnSearchPacketTail(const char *data, size_t len)
@@ -101,7 +159,7 @@ namespace cyber
     }
     size_t HTTPRequestSplitter::RemainDataSize()
     {
-        return remain_data_size_;
+        return header_.size() + content_.Size();
     }
 } // namespace cyber
 
@@ -11,13 +11,20 @@ namespace cyber
         HTTPRequestSplitter() {}
         virtual ~HTTPRequestSplitter() {}
 
+        // data must have a writable byte past len, what is left over is copied
         virtual void Input(const char *data, size_t len);
+        // keep: buf may be held after the call (see Socket::EnableOwnedRead), a partial body or
+        // pipelined request is then kept by reference instead of copied
+        virtual void Input(const Buffer::Ptr &buf, bool keep);
 
     protected:
         virtual ssize_t OnRecvHeader(const char *data, size_t len) = 0;
 
         virtual void OnRecvContent(const char *data, size_t len) = 0;
 
+        // a body that arrived in several buffers. Joined for OnRecvContent by default
+        virtual void OnRecvContentV(const BufferChain &content);
+
         virtual const char *OnSearchPacketTail(const char *data, size_t len);
 
         void SetContentLen(ssize_t content_len);
@@ -27,9 +34,16 @@ namespace cyber
         size_t RemainDataSize();
 
     private:
-        size_t content_len_ = 0;
-        size_t remain_data_size_ = 0;
-        cyber::BufferLikeString remain_data_;
+        void Split(const Buffer::Ptr &buf, const char *ptr, size_t len);
+        size_t SplitHeader(const char *ptr, size_t len);
+        void Hold(const Buffer::Ptr &buf, const char *ptr, size_t len);
+
+    private:
+        ssize_t content_len_ = 0;
+        // a header split across reads, copied: it is small and has to be parsed in one piece
+        std::string header_;
+        // the body so far, by reference to the buffers it came in or copied
+        BufferChain content_;
     };
 
 } // namespace cyber
@@ -8,6 +8,9 @@
 
 #define KEEPALIVESECOND 5
 #define KSENDBUFSIZE 2048
+// bodies this large are sent with MSG_ZEROCOPY, read in chunks worth pinning
+#define KZEROCOPYBODYSIZE (4 * 1024 * 1024)
+#define KZEROCOPYBUFSIZE (256 * 1024)
 
 namespace cyber
 {
@@ -15,6 +18,8 @@ namespace cyber
     {
         // TraceL;
         sock->SetTimeOutSecond(KEEPALIVESECOND);
+        // the splitter keeps partial requests by reference
+        sock->EnableOwnedRead();
     }
     HTTPSession::~HTTPSession(){
         // TraceL;
@@ -23,7 +28,7 @@ namespace cyber
     void HTTPSession::OnRecv(const Buffer::Ptr &buf)
     {
         ticker_.ResetTime();
-        Input(buf->Data(), buf->Size());
+        Input(buf, true);
     }
 
     void HTTPSession::OnError(const SockException &err)
@@ -90,6 +95,13 @@ namespace cyber
         }
     }
 
+    void HTTPSession::OnRecvContentV(const BufferChain &content)
+    {
+        // content_callback_ takes the body piece by piece, no need to join it
+        content.ForEach([this](const char *data, size_t len)
+                        { OnRecvContent(data, len); });
+    }
+
     void HTTPSession::HandleReqGET(ssize_t &content_len)
     {
         HandleReqGETl(content_len, true);
@@ -138,17 +150,19 @@ namespace cyber
     public:
         friend class AsyncSender;
         typedef std::shared_ptr<AsyncSenderData> Ptr;
-        AsyncSenderData(const TCPSession::Ptr &session, const HTTPBody::Ptr &body, bool close_when_complete)
+        AsyncSenderData(const TCPSession::Ptr &session, const HTTPBody::Ptr &body, bool close_when_complete, size_t chunk_size)
         {
             session_ = std::dynamic_pointer_cast<HTTPSession>(session);
             body_ = body;
             close_when_complete_ = close_when_complete;
+            chunk_size_ = chunk_size;
         }
 
     private:
         std::weak_ptr<HTTPSession> session_;
         HTTPBody::Ptr body_;
         bool close_when_complete_;
+        size_t chunk_size_;
         bool read_complete_ = false;
     };
 
@@ -167,7 +181,7 @@ namespace cyber
                 return false;
             }
             data->body_->ReadDataAsync(
-                KSENDBUFSIZE, [data](const Buffer::Ptr &sendbuf)
+                data->chunk_size_, [data](const Buffer::Ptr &sendbuf)
                 {
                     auto session = data->session_.lock();
                     if (!session)
@@ -284,7 +298,14 @@ namespace cyber
             str += "\r\n";
         }
         str += "\r\n";
-        SockSender::Send(std::move(str));
+        size_t chunk_size = KSENDBUFSIZE;
+        if (size >= KZEROCOPYBODYSIZE && GetSocket()->EnableZeroCopy())
+        {
+            chunk_size = KZEROCOPYBUFSIZE;
+        }
+        // a body read at once shares the header's write
+        Buffer::Ptr first = size ? body->ReadData(chunk_size) : nullptr;
+        SendV({std::make_shared<BufferString>(std::move(str)), std::move(first)});
         ticker_.ResetTime();
 
         if (!size)
@@ -294,7 +315,7 @@ namespace cyber
                 Shutdown(SockException(ERR_SHUTDOWN, StrPrinter() << "close connection after send http header completed with status code:" << code));
             }
         }
-        auto body_data = std::make_shared<AsyncSenderData>(shared_from_this(), body, bClose);
+        auto body_data = std::make_shared<AsyncSenderData>(shared_from_this(), body, bClose, chunk_size);
         GetSocket()->SetOnFlush([body_data]()
                                 { return AsyncSender::OnSocketFlushed(body_data); });
         AsyncSender::OnSocketFlushed(body_data);
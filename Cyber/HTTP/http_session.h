@@ -27,6 +27,7 @@ namespace cyber
     protected:
         ssize_t OnRecvHeader(const char *data, size_t len) override;
         void OnRecvContent(const char *data, size_t len) override;
+        void OnRecvContentV(const BufferChain &content) override;
 
     private:
         void HandleReqGET(ssize_t &content_len);
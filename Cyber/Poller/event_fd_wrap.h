@@ -0,0 +1,66 @@
+#if !defined(CYBER_EVENT_FD_WRAP)
+#define CYBER_EVENT_FD_WRAP
+
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "../Util/uv_errno.h"
+#include "../Socket/sockutil.h"
+
+#define CloseFD(fd) \
+    if (fd != -1)   \
+    {               \
+        close(fd);  \
+        fd = -1;    \
+    }
+
+namespace cyber
+{
+    class EventFDWrap
+    {
+    public:
+        EventFDWrap(/* args */)
+        {
+            event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (-1 == event_fd_)
+            {
+                throw std::runtime_error(get_uv_errmsg());
+            }
+        }
+        ~EventFDWrap()
+        {
+            CloseFD(event_fd_);
+        }
+        int Write(uint64_t n = 1)
+        {
+            int ret;
+            do
+            {
+                ret = write(event_fd_, &n, sizeof(n));
+            } while (-1 == ret && UV_EINTR == get_uv_error(true));
+            return ret;
+        }
+        // eventfd keeps a counter instead of a byte stream, one read drains all pending writes
+        uint64_t Read()
+        {
+            uint64_t n = 0;
+            int ret;
+            do
+            {
+                ret = read(event_fd_, &n, sizeof(n));
+            } while (-1 == ret && UV_EINTR == get_uv_error(true));
+            return ret == sizeof(n) ? n : 0;
+        }
+        int FD() const
+        {
+            return event_fd_;
+        }
+
+    private:
+        int event_fd_ = -1;
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_EVENT_FD_WRAP
@@ -0,0 +1,193 @@
+#if !defined(CYBER_IO_URING_WRAP_CPP)
+#define CYBER_IO_URING_WRAP_CPP
+
+#include "io_uring_wrap.h"
+
+#if defined(ENABLE_IO_URING)
+
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../Util/uv_errno.h"
+
+// SINGLE_MMAP, NODROP and EXT_ARG are needed by the ring itself,
+// RSRC_TAGS only tells that the kernel is 5.13+, which brings multishot poll and poll update.
+#define IO_URING_REQUIRED_FEATURES (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS)
+
+namespace cyber
+{
+    static int IOUringSetup(unsigned entries, io_uring_params *params)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    static int IOUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+    }
+
+    IOUringWrap::IOUringWrap(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        // completions of many multishot polls pile up faster than sqes, give the cq ring more room
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = entries * 4;
+        ring_fd_ = IOUringSetup(entries, &params);
+        if (-1 == ring_fd_ && EINVAL == errno)
+        {
+            // older kernel without the optional setup flags
+            memset(&params, 0, sizeof(params));
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = entries * 4;
+            ring_fd_ = IOUringSetup(entries, &params);
+        }
+        if (-1 == ring_fd_)
+        {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + get_uv_errmsg());
+        }
+        if ((params.features & IO_URING_REQUIRED_FEATURES) != IO_URING_REQUIRED_FEATURES)
+        {
+            close(ring_fd_);
+            ring_fd_ = -1;
+            throw std::runtime_error("io_uring lacks the features required by the poller");
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (cq_ring_size > sq_ring_size_)
+        {
+            sq_ring_size_ = cq_ring_size;
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (MAP_FAILED == sq_ring_)
+        {
+            sq_ring_ = nullptr;
+            close(ring_fd_);
+            ring_fd_ = -1;
+            throw std::runtime_error(std::string("io_uring ring mmap failed: ") + get_uv_errmsg());
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = (io_uring_sqe *)mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (MAP_FAILED == (void *)sqes_)
+        {
+            sqes_ = nullptr;
+            munmap(sq_ring_, sq_ring_size_);
+            sq_ring_ = nullptr;
+            close(ring_fd_);
+            ring_fd_ = -1;
+            throw std::runtime_error(std::string("io_uring sqes mmap failed: ") + get_uv_errmsg());
+        }
+
+        char *ring = (char *)sq_ring_;
+        sq_head_ = (unsigned *)(ring + params.sq_off.head);
+        sq_tail_ = (unsigned *)(ring + params.sq_off.tail);
+        sq_mask_ = (unsigned *)(ring + params.sq_off.ring_mask);
+        sq_array_ = (unsigned *)(ring + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = (unsigned *)(ring + params.cq_off.head);
+        cq_tail_ = (unsigned *)(ring + params.cq_off.tail);
+        cq_mask_ = (unsigned *)(ring + params.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe *)(ring + params.cq_off.cqes);
+
+        // sqes are always used in ring order, so the index array never changes
+        for (unsigned i = 0; i < sq_entries_; ++i)
+        {
+            sq_array_[i] = i;
+        }
+    }
+
+    IOUringWrap::~IOUringWrap()
+    {
+        if (sqes_)
+        {
+            munmap(sqes_, sqes_size_);
+        }
+        if (sq_ring_)
+        {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (ring_fd_ != -1)
+        {
+            close(ring_fd_);
+            ring_fd_ = -1;
+        }
+    }
+
+    io_uring_sqe *IOUringWrap::GetSqe()
+    {
+        unsigned tail = *sq_tail_;
+        while (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_)
+        {
+            Submit();
+        }
+        io_uring_sqe *sqe = &sqes_[tail & *sq_mask_];
+        memset(sqe, 0, sizeof(*sqe));
+        // without SQPOLL the kernel only looks at the ring inside io_uring_enter,
+        // which this thread calls after filling the sqe in
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++pending_;
+        return sqe;
+    }
+
+    int IOUringWrap::Submit()
+    {
+        if (!pending_)
+        {
+            return 0;
+        }
+        int ret;
+        do
+        {
+            ret = IOUringEnter(ring_fd_, pending_, 0, 0, nullptr, 0);
+        } while (-1 == ret && EINTR == errno);
+        if (ret > 0)
+        {
+            pending_ -= ret;
+        }
+        return ret;
+    }
+
+    unsigned IOUringWrap::ReadyCqe() const
+    {
+        return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+    }
+
+    int IOUringWrap::Wait(int timeout_ms)
+    {
+        unsigned ready = ReadyCqe();
+        if (ready && !pending_)
+        {
+            return ready;
+        }
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        __kernel_timespec ts;
+        if (timeout_ms >= 0)
+        {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+            arg.ts = (uint64_t)&ts;
+        }
+        int ret = IOUringEnter(ring_fd_, pending_, ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if (ret >= 0)
+        {
+            pending_ -= ret;
+            return ReadyCqe();
+        }
+        if (ETIME == errno || EINTR == errno || EBUSY == errno || EAGAIN == errno)
+        {
+            // timed out, interrupted, or the kernel holds back completions until the cq ring is drained
+            return ReadyCqe();
+        }
+        return -1;
+    }
+
+} // namespace cyberweb
+
+#endif // ENABLE_IO_URING
+
+#endif // CYBER_IO_URING_WRAP_CPP
@@ -0,0 +1,73 @@
+#if !defined(CYBER_IO_URING_WRAP_H)
+#define CYBER_IO_URING_WRAP_H
+
+#if defined(ENABLE_IO_URING)
+
+#include <linux/io_uring.h>
+
+#include "../Util/util.h"
+
+namespace cyber
+{
+    // minimal io_uring ring driven through the raw syscalls, liburing is not required.
+    // sqes are only queued by GetSqe, they reach the kernel with the next Submit or Wait,
+    // so everything a loop iteration queues costs one io_uring_enter.
+    class IOUringWrap : public noncopyable
+    {
+    public:
+        // throw if the kernel lacks io_uring or a feature the poller relies on
+        IOUringWrap(unsigned entries);
+        ~IOUringWrap();
+
+        // never null, submits the queued sqes first when the ring is full
+        io_uring_sqe *GetSqe();
+
+        int Submit();
+
+        // submit the queued sqes and wait up to timeout_ms (-1 forever) for a completion,
+        // return the number of ready cqes or -1 with errno set
+        int Wait(int timeout_ms);
+
+        template <typename FUN>
+        unsigned ForEachCqe(FUN &&fun)
+        {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            unsigned count = tail - head;
+            for (; head != tail; ++head)
+            {
+                io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+                fun(cqe->user_data, cqe->res, cqe->flags);
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            return count;
+        }
+
+    private:
+        unsigned ReadyCqe() const;
+
+    private:
+        int ring_fd_ = -1;
+        unsigned pending_ = 0;
+
+        void *sq_ring_ = nullptr;
+        size_t sq_ring_size_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        size_t sqes_size_ = 0;
+        unsigned *sq_head_;
+        unsigned *sq_tail_;
+        unsigned *sq_mask_;
+        unsigned *sq_array_;
+        unsigned sq_entries_;
+
+        unsigned *cq_head_;
+        unsigned *cq_tail_;
+        unsigned *cq_mask_;
+        io_uring_cqe *cqes_;
+    };
+
+} // namespace cyberweb
+
+#endif // ENABLE_IO_URING
+
+#endif // CYBER_IO_URING_WRAP_H
@@ -1,46 +1,83 @@
 #if !defined(CYBER_POLLER_CPP)
 #define CYBER_POLLER_CPP
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <sys/unistd.h>
 #include "sys/epoll.h"
-#include <map>
 
 #include "poller.h"
+#include "../Util/cpu_info.h"
 #include "../Util/util.h"
 
 #define EPOLL_SIZE 1024
+// first spin budget once busy polling sees events arriving soon after it blocked
+#define BUSY_POLL_START_USEC 10
+#define BUSY_POLL_PAUSE 32
+#define SLOW_CALLBACK_THRESHOLD_MS 50
+#define SLOW_CALLBACK_SAMPLE_EVERY 16
 // #define SOCKET_DEFAULT_BUF_SIZE 2048
 
-#define ToEpoll(event) (((event)&EVENT_READ) ? EPOLLIN : 0) | (((event)&EVENT_WRITE) ? EPOLLOUT : 0) | (((event)&EVENT_ERROR) ? (EPOLLHUP | EPOLLERR) : 0) | (((event)&EVENT_LT) ? 0 : EPOLLET)
+#define ToEpoll(event) (((event)&EVENT_READ) ? EPOLLIN : 0) | (((event)&EVENT_WRITE) ? EPOLLOUT : 0) | (((event)&EVENT_ERROR) ? (EPOLLHUP | EPOLLERR) : 0) | (((event)&EVENT_LT) ? 0 : EPOLLET) | (((event)&EVENT_EXCLUSIVE) ? EPOLLEXCLUSIVE : 0)
 
 #define ToPoller(event) (((event)&EPOLLIN) ? EVENT_READ : 0) | (((event)&EPOLLOUT) ? EVENT_WRITE : 0) | (((event)&EPOLLHUP) ? EVENT_ERROR : 0) | (((event)&EPOLLERR) ? EVENT_ERROR : 0)
 
 namespace cyber
 {
+    static inline void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+#if defined(ENABLE_IO_URING)
+    static bool s_enable_io_uring = true;
+#endif
+
     EventPoller &EventPoller::Instance()
     {
         return *(EventPollerPool::Instance().GetFirstPoller());
     }
 
-    EventPoller::EventPoller(ThreadPool::Priority priority)
+    EventPoller::EventPoller(ThreadPool::Priority priority) : slow_callback_(SLOW_CALLBACK_THRESHOLD_MS, SLOW_CALLBACK_SAMPLE_EVERY), delay_task_wheel_(GetCurrentMillisecond())
     {
         priority_ = priority;
-        SockUtil::SetNoBlocked(pipe_.ReadFD());
-        SockUtil::SetNoBlocked(pipe_.WriteFD());
+        delay_task_wheel_.SetSlowCallbackDetector(&slow_callback_);
 
-        epoll_fd_ = epoll_create(EPOLL_SIZE);
-        if (epoll_fd_ == -1)
+        epoll_fd_ = -1;
+#if defined(ENABLE_IO_URING)
+        if (s_enable_io_uring)
         {
-            ErrorL << "create epoll fd failed: " << get_uv_errmsg();
-            throw "create epoll fd fail!";
+            try
+            {
+                uring_.reset(new IOUringWrap(EPOLL_SIZE));
+            }
+            catch (std::exception &ex)
+            {
+                WarnL << "io_uring unavailable, fall back to epoll: " << ex.what();
+            }
+        }
+        if (!uring_)
+#endif
+        {
+            epoll_fd_ = epoll_create(EPOLL_SIZE);
+            if (epoll_fd_ == -1)
+            {
+                ErrorL << "create epoll fd failed: " << get_uv_errmsg();
+                throw "create epoll fd fail!";
+            }
+            SockUtil::setCloExec(epoll_fd_);
         }
-        SockUtil::setCloExec(epoll_fd_);
 
         logger_ = Logger::Instance().shared_from_this();
         loop_thread_id_ = std::this_thread::get_id();
-        if (-1 == AddEvent(pipe_.ReadFD(), EVENT_READ, [this](int event)
-                           { OnPipeEvent(); }))
+        if (-1 == AddEvent(event_fd_.FD(), EVENT_READ, [this](int event)
+                           { OnWakeUpEvent(); }))
         {
-            throw std::runtime_error("poller adding pipe event failed");
+            throw std::runtime_error("poller adding eventfd event failed");
         }
     }
 
@@ -73,7 +110,7 @@ namespace cyber
             epoll_fd_ = -1;
         }
         loop_thread_id_ = std::this_thread::get_id();
-        OnPipeEvent();
+        OnWakeUpEvent();
         InfoL << this << ":" << loop_thread_id_ << std::endl;
     }
 
@@ -86,13 +123,36 @@ namespace cyber
         }
         if (IsCurrentThread())
         {
+            if (fd < 0)
+            {
+                return -1;
+            }
+            if ((size_t)fd >= event_table_.size())
+            {
+                event_table_.resize(std::max((size_t)fd + 1, event_table_.size() * 2));
+            }
+            if (event_table_[fd])
+            {
+                WarnL << "fd " << fd << " already added to poller";
+                return -1;
+            }
+            std::unique_ptr<EventHandler> handler(new EventHandler(fd, event, std::move(cb)));
+#if defined(ENABLE_IO_URING)
+            if (uring_)
+            {
+                // a failed poll request shows up as an EVENT_ERROR completion
+                UringPollAdd(handler.get());
+                event_table_[fd] = std::move(handler);
+                return 0;
+            }
+#endif
             epoll_event ev = {0};
-            ev.events = ToEpoll(event) | EPOLLEXCLUSIVE;
-            ev.data.fd = fd;
+            ev.events = ToEpoll(event);
+            ev.data.ptr = handler.get();
             int ret = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
             if (ret == 0)
             {
-                event_map_.emplace(fd, std::make_shared<PollEventCB>(std::move(cb)));
+                event_table_[fd] = std::move(handler);
             }
             return ret;
         }
@@ -111,7 +171,33 @@ namespace cyber
 
         if (IsCurrentThread())
         {
-            bool success = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL) == 0 && event_map_.erase(fd) > 0;
+            bool success = false;
+            if (fd >= 0 && (size_t)fd < event_table_.size() && event_table_[fd])
+            {
+                auto &handler = event_table_[fd];
+                handler->alive_ = false;
+#if defined(ENABLE_IO_URING)
+                if (uring_)
+                {
+                    success = true;
+                    if (handler->armed_)
+                    {
+                        // freed by the final completion of its poll request
+                        UringPollRemove(handler.get());
+                        event_removing_.emplace_back(std::move(handler));
+                    }
+                    else
+                    {
+                        event_garbage_.emplace_back(std::move(handler));
+                    }
+                }
+                else
+#endif
+                {
+                    success = epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL) == 0;
+                    event_garbage_.emplace_back(std::move(handler));
+                }
+            }
             cb(success);
             return success ? 0 : -1;
         }
@@ -124,11 +210,93 @@ namespace cyber
 
     int EventPoller::ModifyEvent(int fd, int event)
     {
-        Ticker();
+        if (!IsCurrentThread())
+        {
+            Async([this, fd, event]()
+                  { ModifyEvent(fd, event); });
+            return 0;
+        }
+        if (fd < 0 || (size_t)fd >= event_table_.size() || !event_table_[fd])
+        {
+            return -1;
+        }
+        auto handler = event_table_[fd].get();
+        handler->event_ = event | (handler->event_ & EVENT_EXCLUSIVE);
+        if (dispatching_)
+        {
+            if (!handler->dirty_)
+            {
+                handler->dirty_ = true;
+                event_dirty_.emplace_back(handler);
+            }
+            return 0;
+        }
+        ApplyEventMask(handler);
+        return 0;
+    }
+
+    uint64_t EventPoller::GetLoopMillisecond() const
+    {
+        return loop_time_.load(std::memory_order_relaxed);
+    }
+
+    int EventPoller::GetSocketCount() const
+    {
+        return socket_count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t EventPoller::GetAvoidedModifyCount() const
+    {
+        return modify_avoided_.load(std::memory_order_relaxed);
+    }
+
+    void EventPoller::ApplyEventMask(EventHandler *handler)
+    {
+        if (handler->event_ == handler->registered_)
+        {
+            modify_avoided_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        handler->registered_ = handler->event_;
+#if defined(ENABLE_IO_URING)
+        if (uring_)
+        {
+            UringPollUpdate(handler);
+            return;
+        }
+#endif
         epoll_event ev = {0};
-        ev.events = ToEpoll(event);
-        ev.data.fd = fd;
-        return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+        ev.events = ToEpoll(handler->event_);
+        ev.data.ptr = handler;
+        int ret;
+        if (handler->event_ & EVENT_EXCLUSIVE)
+        {
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, handler->fd_, NULL);
+            ret = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, handler->fd_, &ev);
+        }
+        else
+        {
+            ret = epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, handler->fd_, &ev);
+        }
+        if (-1 == ret)
+        {
+            WarnL << "modify event of fd " << handler->fd_ << " failed: " << get_uv_errmsg();
+        }
+    }
+
+    void EventPoller::FlushEventMask()
+    {
+        dispatching_ = false;
+        for (auto handler : event_dirty_)
+        {
+            // a handler deleted during the batch is still parked in event_garbage_ or event_removing_
+            handler->dirty_ = false;
+            if (handler->alive_)
+            {
+                ApplyEventMask(handler);
+            }
+        }
+        event_dirty_.clear();
     }
 
     Task::Ptr EventPoller::Async(TaskIn task, bool may_sync)
@@ -143,7 +311,6 @@ namespace cyber
 
     Task::Ptr EventPoller::AsyncL(TaskIn task, bool may_sync, bool first)
     {
-        Ticker();
         if (may_sync && IsCurrentThread())
         {
             task();
@@ -151,19 +318,20 @@ namespace cyber
         }
 
         auto ret = std::make_shared<Task>(std::move(task));
+        if (first)
         {
-            LOCKGUARD(mtx_task_);
-            if (first)
-            {
-                list_task_.emplace_front(ret);
-            }
-            else
-            {
-                list_task_.emplace_back(ret);
-            }
+            task_queue_first_.Push(ret);
+        }
+        else
+        {
+            task_queue_.Push(ret);
         }
 
-        pipe_.Write("", 1);
+        // only the first task of a batch pays for the syscall, the loop clears the flag before draining
+        if (!wakeup_pending_.exchange(true, std::memory_order_acq_rel))
+        {
+            event_fd_.Write();
+        }
         return ret;
     }
 
@@ -172,42 +340,34 @@ namespace cyber
         return loop_thread_id_ == std::this_thread::get_id();
     }
 
-    inline void EventPoller::OnPipeEvent()
+    inline void EventPoller::OnWakeUpEvent()
     {
-        Ticker();
-        char buf[1024];
-        int err = 0;
-        do
-        {
-            if (pipe_.Read(buf, sizeof(buf)) > 0)
-            {
-                continue;
-            }
-            err = get_uv_error(true);
-        } while (err != UV_EAGAIN);
+        event_fd_.Read();
+        wakeup_pending_.store(false, std::memory_order_seq_cst);
 
-        decltype(list_task_) list_swap;
+        auto run_task = [&](const Task::Ptr &task)
         {
-            LOCKGUARD(mtx_task_);
-            list_swap.swap(list_task_);
-        }
-
-        list_swap.ForEach(
-            [&](const Task::Ptr &task)
+            uint64_t begin = slow_callback_.Begin();
+            try
             {
-                try
-                {
-                    (*task)();
-                }
-                catch (ExitException &)
-                {
-                    exit_flag_ = true;
-                }
-                catch (const std::exception &e)
+                (*task)();
+                if (begin)
                 {
-                    ErrorL << "EventPoller excute async task error: " << e.what() << '\n';
+                    slow_callback_.End(begin, "task", task->TargetType());
                 }
-            });
+            }
+            catch (ExitException &)
+            {
+                exit_flag_ = true;
+            }
+            catch (const std::exception &e)
+            {
+                ErrorL << "EventPoller excute async task error: " << e.what() << '\n';
+            }
+        };
+        // AsyncFirst tasks run newest first and ahead of everything queued by Async
+        task_queue_first_.PopAll(run_task, false);
+        task_queue_.PopAll(run_task);
     }
 
     void EventPoller::Wait()
@@ -227,67 +387,82 @@ namespace cyber
         return buffer;
     }
 
-    static std::mutex s_all_poller_mtx;
-    static std::map<std::thread::id, std::weak_ptr<EventPoller>> s_all_poller;
+    BufferRaw::Ptr EventPoller::GetReadBuffer(size_t size)
+    {
+        auto buffer = BufferRaw::Create();
+        buffer->SetCapacity(size + 1);
+        return buffer;
+    }
+
+    BufferStore::Stats EventPoller::GetBufferStats() const
+    {
+        auto store = buffer_store_.load();
+        return store ? store->GetStats() : BufferStore::Stats{0, 0, 0, 0};
+    }
+
+    // set by RunLoop on the loop thread, so finding the current poller takes no lock
+    static thread_local std::weak_ptr<EventPoller> s_current_poller;
 
     EventPoller::Ptr EventPoller::GetCurrentPoller()
     {
-        LOCKGUARD(s_all_poller_mtx);
-        auto it = s_all_poller.find(std::this_thread::get_id());
-        if (it == s_all_poller.end())
-        {
-            return nullptr;
-        }
-        return it->second.lock();
+        return s_current_poller.lock();
     }
 
     void EventPoller::RunLoop(bool blocked, bool regist_self)
     {
         if (blocked)
         {
+            if (cpu_ >= 0 && !SetThreadAffinity(cpu_))
+            {
+                WarnL << "pin EventPoller to cpu " << cpu_ << " failed: " << get_uv_errmsg();
+                cpu_ = -1;
+            }
             ThreadPool::SetPriority(priority_);
             LOCKGUARD(mtx_runing_);
             loop_thread_id_ = std::this_thread::get_id();
             if (regist_self)
             {
-                LOCKGUARD(s_all_poller_mtx);
-                s_all_poller[loop_thread_id_] = shared_from_this();
+                s_current_poller = shared_from_this();
             }
+            buffer_store_ = BufferStore::Attach();
             sem_run_started_.Post();
             exit_flag_ = false;
+            loop_time_ = GetCurrentMillisecond();
             uint64_t min_delay;
             epoll_event events[EPOLL_SIZE];
             while (!exit_flag_)
             {
                 min_delay = GetMinDelay();
                 StartSleep();
-                int ret = epoll_wait(epoll_fd_, events, EPOLL_SIZE, min_delay ? min_delay : -1);
-                SleepWakeUp();
+                int ret = WaitEvents(events, min_delay);
+                uint64_t now = GetCurrentMicrosecond();
+                loop_time_.store(now / 1000, std::memory_order_relaxed);
+                SleepWakeUp(now);
                 if (ret <= 0)
                 {
                     continue;
                 }
-                for (int i = 0; i < ret; ++i)
+                dispatching_ = true;
+#if defined(ENABLE_IO_URING)
+                if (uring_)
                 {
-                    epoll_event &ev = events[i];
-                    int fd = ev.data.fd;
-                    auto it = event_map_.find(fd);
-                    if (it == event_map_.end())
-                    {
-                        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL);
-                        continue;
-                    }
-                    auto cb = it->second;
-                    try
-                    {
-                        (*cb)(ToPoller(ev.events));
-                    }
-                    catch (std::exception &ex)
+                    uring_->ForEachCqe([this](uint64_t user_data, int res, uint32_t flags)
+                                       { OnUringCompletion(user_data, res, flags); });
+                }
+                else
+#endif
+                {
+                    for (int i = 0; i < ret; ++i)
                     {
-                        ErrorL << "EventPoller callback fail" << ex.what();
+                        epoll_event &ev = events[i];
+                        OnEvent(static_cast<EventHandler *>(ev.data.ptr), ToPoller(ev.events));
                     }
                 }
+                FlushEventMask();
+                event_garbage_.clear();
             }
+            buffer_store_ = nullptr;
+            BufferStore::Detach();
         }
         else
         {
@@ -296,51 +471,202 @@ namespace cyber
         }
     }
 
-    uint64_t EventPoller::FlushDelayTask(uint64_t now_time)
+    inline void EventPoller::OnEvent(EventHandler *handler, int event)
     {
-        decltype(delay_task_map_) task_copy;
-        task_copy.swap(delay_task_map_);
+        if (!handler->alive_)
+        {
+            return;
+        }
+        // the wakeup handler only runs tasks, which are timed one by one
+        uint64_t begin = handler->fd_ != event_fd_.FD() ? slow_callback_.Begin() : 0;
+        try
+        {
+            handler->cb_(event);
+            if (begin)
+            {
+                slow_callback_.End(begin, "event", handler->cb_.target_type(), handler->fd_);
+            }
+        }
+        catch (std::exception &ex)
+        {
+            ErrorL << "EventPoller callback fail" << ex.what();
+        }
+    }
+
+#if defined(ENABLE_IO_URING)
+    // level triggered fds use one-shot polls re-armed after every completion,
+    // edge triggered ones a multishot poll that only completes on new wakeups
+    void EventPoller::UringPollAdd(EventHandler *handler)
+    {
+        auto sqe = uring_->GetSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = handler->fd_;
+        sqe->poll32_events = ToEpoll(handler->event_);
+        sqe->len = (handler->event_ & EVENT_LT) ? 0 : IORING_POLL_ADD_MULTI;
+        sqe->user_data = (uint64_t)handler;
+        handler->armed_ = true;
+        handler->registered_ = handler->event_;
+    }
 
-        for (auto it = task_copy.begin(); it != task_copy.end() && it->first <= now_time; it = task_copy.erase(it))
+    void EventPoller::UringPollUpdate(EventHandler *handler)
+    {
+        if (!handler->armed_)
         {
-            try
+            // the next UringPollAdd picks up the new mask
+            return;
+        }
+        auto sqe = uring_->GetSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)handler;
+        sqe->poll32_events = ToEpoll(handler->event_);
+        sqe->len = IORING_POLL_UPDATE_EVENTS | ((handler->event_ & EVENT_LT) ? 0 : IORING_POLL_ADD_MULTI);
+        sqe->user_data = 0;
+    }
+
+    void EventPoller::UringPollRemove(EventHandler *handler)
+    {
+        auto sqe = uring_->GetSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)handler;
+        sqe->user_data = 0;
+    }
+
+    void EventPoller::OnUringCompletion(uint64_t user_data, int res, uint32_t flags)
+    {
+        auto handler = (EventHandler *)user_data;
+        if (!handler)
+        {
+            // result of a poll update or remove, the poll request itself reports what matters
+            return;
+        }
+        bool more = flags & IORING_CQE_F_MORE;
+        if (!more)
+        {
+            handler->armed_ = false;
+        }
+        if (!handler->alive_)
+        {
+            if (!more)
             {
-                /* code */
-                auto next_delay = (*(it->second))();
-                if (next_delay)
+                for (auto &removing : event_removing_)
                 {
-                    delay_task_map_.emplace(next_delay + now_time, std::move(it->second));
+                    if (removing.get() == handler)
+                    {
+                        removing = std::move(event_removing_.back());
+                        event_removing_.pop_back();
+                        break;
+                    }
                 }
             }
-            catch (const std::exception &e)
-            {
-                ErrorL << "EventPoller execute delay task error: " << e.what() << '\n';
-            }
+            return;
+        }
+        if (res < 0 && res != -ECANCELED)
+        {
+            WarnL << "io_uring poll on fd " << handler->fd_ << " failed: " << uv_strerror(res);
+            OnEvent(handler, EVENT_ERROR);
+            return;
         }
+        if (res > 0)
+        {
+            OnEvent(handler, ToPoller(res));
+        }
+        if (!more && handler->alive_)
+        {
+            UringPollAdd(handler);
+        }
+    }
+#endif
 
-        task_copy.insert(delay_task_map_.begin(), delay_task_map_.end());
-        task_copy.swap(delay_task_map_);
-        auto it = delay_task_map_.begin();
-        if (it == delay_task_map_.end())
+    int EventPoller::PollEvents(epoll_event *events, int timeout_ms)
+    {
+#if defined(ENABLE_IO_URING)
+        if (uring_)
         {
-            return 0;
+            // also submits every poll request queued since the last round
+            return uring_->Wait(timeout_ms);
         }
-        return it->first - now_time;
+#endif
+        return epoll_wait(epoll_fd_, events, EPOLL_SIZE, timeout_ms);
     }
 
-    uint64_t EventPoller::GetMinDelay()
+    int EventPoller::WaitEvents(epoll_event *events, uint64_t min_delay)
     {
-        auto it = delay_task_map_.begin();
-        if (it == delay_task_map_.end())
+        int timeout = min_delay ? (int)std::min<uint64_t>(min_delay, INT_MAX) : -1;
+        uint64_t max_spin = busy_poll_max_usec_.load(std::memory_order_relaxed);
+        if (!max_spin)
         {
-            return 0;
+            return PollEvents(events, timeout);
+        }
+
+        uint64_t start = GetCurrentMicrosecond();
+        spin_usec_ = std::min(spin_usec_, max_spin);
+        if (spin_usec_)
+        {
+            uint64_t spin = min_delay ? std::min(spin_usec_, min_delay * 1000) : spin_usec_;
+            uint64_t deadline = start + spin;
+            do
+            {
+                int ret = PollEvents(events, 0);
+                if (ret != 0)
+                {
+                    return ret;
+                }
+                for (int i = 0; i < BUSY_POLL_PAUSE; ++i)
+                {
+                    CpuRelax();
+                }
+            } while (GetCurrentMicrosecond() < deadline);
         }
-        auto now = GetCurrentMillisecond();
-        if (it->first > now)
+
+        uint64_t block_start = GetCurrentMicrosecond();
+        if (timeout > 0)
         {
-            return it->first - now;
+            timeout = std::max<int>(0, timeout - (int)((block_start - start) / 1000));
         }
-        return FlushDelayTask(now);
+        int ret = PollEvents(events, timeout);
+        uint64_t waited = GetCurrentMicrosecond() - block_start;
+        if (ret > 0 && waited <= max_spin)
+        {
+            // the event came in soon enough that a longer spin would have caught it
+            spin_usec_ = spin_usec_ ? std::min(spin_usec_ * 2, max_spin) : std::min<uint64_t>(BUSY_POLL_START_USEC, max_spin);
+        }
+        else
+        {
+            spin_usec_ /= 2;
+        }
+        return ret;
+    }
+
+    int EventPoller::GetCpu() const
+    {
+        return cpu_;
+    }
+
+    int EventPoller::GetNumaNode() const
+    {
+        return cpu_ >= 0 ? GetCpuNumaNode(cpu_) : -1;
+    }
+
+    void EventPoller::SetBusyPoll(uint64_t max_spin_usec)
+    {
+        busy_poll_max_usec_.store(max_spin_usec, std::memory_order_relaxed);
+    }
+
+    void EventPoller::SetSlowCallbackCheck(uint64_t threshold_ms, uint32_t sample_every)
+    {
+        slow_callback_.Set(threshold_ms, sample_every);
+    }
+
+    uint64_t EventPoller::GetSlowCallbackCount() const
+    {
+        return slow_callback_.GetCount();
+    }
+
+    uint64_t EventPoller::GetMinDelay()
+    {
+        return delay_task_wheel_.Flush(GetCurrentMillisecond());
     }
 
     DelayTask::Ptr EventPoller::DoDelayTask(uint64_t delay_ms, std::function<uint64_t()> task)
@@ -348,11 +674,12 @@ namespace cyber
         DelayTask::Ptr ret = std::make_shared<DelayTask>(std::move(task));
         auto time_line = delay_ms + GetCurrentMillisecond();
         AsyncFirst([this, time_line, ret]()
-                   { delay_task_map_.emplace(time_line, ret); });
+                   { delay_task_wheel_.Add(time_line, ret); });
         return ret;
     }
 
     int s_pool_size = 0;
+    static bool s_enable_cpu_affinity = true;
 
     EventPollerPool &EventPollerPool::Instance()
     {
@@ -377,6 +704,79 @@ namespace cyber
         return std::dynamic_pointer_cast<EventPoller>(GetExecutor());
     }
 
+    EventPoller::Ptr EventPollerPool::PollerAt(size_t index)
+    {
+        return std::static_pointer_cast<EventPoller>(threads_[index % threads_.size()]);
+    }
+
+    static size_t HashAddress(const sockaddr *addr)
+    {
+        // FNV-1a over the ip only, a client keeps its poller across source ports
+        const uint8_t *data = nullptr;
+        size_t len = 0;
+        if (addr->sa_family == AF_INET)
+        {
+            data = (const uint8_t *)&((const sockaddr_in *)addr)->sin_addr;
+            len = sizeof(in_addr);
+        }
+        else if (addr->sa_family == AF_INET6)
+        {
+            data = (const uint8_t *)&((const sockaddr_in6 *)addr)->sin6_addr;
+            len = sizeof(in6_addr);
+        }
+        size_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < len; ++i)
+        {
+            hash = (hash ^ data[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    EventPoller::Ptr EventPollerPool::GetPoller(PlacementPolicy policy, const sockaddr *addr)
+    {
+        size_t size = threads_.size();
+        switch (policy)
+        {
+        case PLACE_TWO_CHOICES:
+        {
+            static thread_local uint32_t s_seed = (uint32_t)(uintptr_t)&s_seed;
+            s_seed = s_seed * 1103515245 + 12345;
+            size_t first = (s_seed >> 8) % size;
+            size_t second = size > 1 ? (first + 1 + (s_seed >> 20) % (size - 1)) % size : first;
+            auto &a = threads_[first];
+            auto &b = threads_[second];
+            return std::static_pointer_cast<EventPoller>(b->CachedLoad() < a->CachedLoad() ? b : a);
+        }
+        case PLACE_LEAST_CONNECTIONS:
+        {
+            // start from a rotating index so ties do not all go to the first poller
+            size_t start = round_robin_.fetch_add(1, std::memory_order_relaxed);
+            EventPoller *best = nullptr;
+            size_t best_index = 0;
+            for (size_t i = 0; i < size; ++i)
+            {
+                auto poller = static_cast<EventPoller *>(threads_[(start + i) % size].get());
+                if (!best || poller->GetSocketCount() < best->GetSocketCount())
+                {
+                    best = poller;
+                    best_index = (start + i) % size;
+                }
+            }
+            return PollerAt(best_index);
+        }
+        case PLACE_IP_HASH:
+            if (addr && (addr->sa_family == AF_INET || addr->sa_family == AF_INET6))
+            {
+                return PollerAt(HashAddress(addr));
+            }
+            return PollerAt(round_robin_.fetch_add(1, std::memory_order_relaxed));
+        case PLACE_ROUND_ROBIN:
+            return PollerAt(round_robin_.fetch_add(1, std::memory_order_relaxed));
+        default:
+            return GetPoller();
+        }
+    }
+
     void EventPollerPool::PreferCurrentThread(bool flag)
     {
         prefer_current_thread_ = flag;
@@ -384,15 +784,47 @@ namespace cyber
 
     EventPollerPool::EventPollerPool()
     {
-        auto size = s_pool_size > 0 ? s_pool_size : std::thread::hardware_concurrency();
-        CreateThreads([]()
+        // hardware_concurrency ignores both the affinity mask and the cgroup quota of a container
+        auto size = s_pool_size > 0 ? s_pool_size : GetEffectiveCpuCount();
+        auto cpus = GetAffinityCpus();
+        size_t index = 0;
+        CreateThreads([&]()
                       {
-                          EventPoller::Ptr ret(new EventPoller());
+                          int cpu = s_enable_cpu_affinity ? cpus[index++ % cpus.size()] : -1;
+                          // built on a thread already sitting on that cpu, so first touch places
+                          // the poller and everything its constructor allocates on the local numa node
+                          EventPoller::Ptr ret;
+                          std::exception_ptr ex;
+                          std::thread([&]()
+                                      {
+                                          if (cpu >= 0)
+                                          {
+                                              SetThreadAffinity(cpu);
+                                          }
+                                          try
+                                          {
+                                              ret.reset(new EventPoller());
+                                          }
+                                          catch (...)
+                                          {
+                                              ex = std::current_exception();
+                                          } })
+                              .join();
+                          if (ex)
+                          {
+                              std::rethrow_exception(ex);
+                          }
+                          ret->cpu_ = cpu;
                           ret->RunLoop(false, true);
                           return ret;
                       },
                       size);
         InfoL << "create EventPoller size: " << size << std::endl;
+        ForEach([](const TaskExecutor::Ptr &executor)
+                {
+                    auto poller = std::static_pointer_cast<EventPoller>(executor);
+                    InfoL << "EventPoller " << poller.get() << " cpu: " << poller->GetCpu() << " numa node: " << poller->GetNumaNode();
+                });
     }
 
     void EventPollerPool::SetPoolSize(int size)
@@ -400,6 +832,18 @@ namespace cyber
         s_pool_size = size;
     }
 
+    void EventPollerPool::EnableCpuAffinity(bool enable)
+    {
+        s_enable_cpu_affinity = enable;
+    }
+
+#if defined(ENABLE_IO_URING)
+    void EventPollerPool::EnableIOUring(bool enable)
+    {
+        s_enable_io_uring = enable;
+    }
+#endif
+
 } // namespace cyberweb
 
 #endif // CYBER_POLLER_CPP
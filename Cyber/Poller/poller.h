@@ -1,16 +1,22 @@
 #if !defined(CYBER_POLLER_H)
 #define CYBER_POLLER_H
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
 
 #include "../Socket/buffer.h"
 #include "../Thread/task_executor.h"
 #include "../Thread/thread_pool.h"
 #include "../Util/logger.h"
-#include "pipe_wrap.h"
+#include "event_fd_wrap.h"
+#include "io_uring_wrap.h"
+#include "slow_callback.h"
+#include "timing_wheel.h"
 
 namespace cyber
 {
@@ -19,11 +25,14 @@ namespace cyber
         EVENT_READ = 1 << 0,
         EVENT_WRITE = 1 << 1,
         EVENT_ERROR = 1 << 2,
-        EVENT_LT = 1 << 3
+        EVENT_LT = 1 << 3,
+        // fd shared by several pollers, a wakeup reaches only one of them; epoll refuses to modify it in place
+        EVENT_EXCLUSIVE = 1 << 4
     } PollEvent;
     typedef std::function<void(int event)> PollEventCB;
     typedef std::function<void(bool success)> PollDelCB;
-    typedef TaskCancelableImp<uint64_t(void)> DelayTask;
+
+    class Socket;
 
     class EventPoller : public TaskExecutor, public std::enable_shared_from_this<EventPoller>
     {
@@ -31,7 +40,7 @@ namespace cyber
         typedef std::shared_ptr<EventPoller> Ptr;
 
         friend class EventPollerPool;
-        friend class WorkThreadPool;
+        friend class Socket;
 
         ~EventPoller();
 
@@ -41,8 +50,38 @@ namespace cyber
 
         int DelEvent(int fd, PollDelCB cb = nullptr);
 
+        // a mask equal to the registered one costs nothing, changes made while a batch of events
+        // is dispatched are coalesced and applied once after the batch
         int ModifyEvent(int fd, int event);
 
+        // ModifyEvent calls that did not have to reach the kernel
+        uint64_t GetAvoidedModifyCount() const;
+
+        // cpu the loop thread is pinned to, -1 when not pinned
+        int GetCpu() const;
+
+        int GetNumaNode() const;
+
+        // live Socket objects bound to this poller
+        int GetSocketCount() const;
+
+        // time the loop woke up for the batch being dispatched, read once per iteration.
+        // Free for callbacks that only need the batch's time, like uv_now().
+        uint64_t GetLoopMillisecond() const;
+
+        // opt-in busy polling: before blocking, keep polling for up to max_spin_usec after the last event.
+        // The budget in use grows while events keep arriving within it and shrinks when they do not;
+        // spinning counts as idle time in Load() unless ThreadLoadCounter::UseThreadCpuTime is on.
+        // 0 turns it off. Only worth it on a core of its own.
+        void SetBusyPoll(uint64_t max_spin_usec);
+
+        // warn about event, task and timer callbacks that hold the loop for threshold_ms or longer,
+        // timing one callback in every sample_every. On by default at 50ms, 1 in 16; 0 turns it off.
+        void SetSlowCallbackCheck(uint64_t threshold_ms, uint32_t sample_every = 16);
+
+        // callbacks the check has caught so far
+        uint64_t GetSlowCallbackCount() const;
+
         Task::Ptr Async(TaskIn task, bool may_sync = true) override;
 
         Task::Ptr AsyncFirst(TaskIn task, bool may_sync = true) override;
@@ -54,13 +93,35 @@ namespace cyber
         static EventPoller::Ptr GetCurrentPoller();
 
         BufferRaw::Ptr GetSharedBuffer();
+        // a buffer with room for size bytes and a terminating 0, taken from the poller's BufferStore and
+        // owned by the caller, who may keep it. On the poller's thread
+        BufferRaw::Ptr GetReadBuffer(size_t size);
+        // of the poller thread's BufferStore, zero until the loop runs
+        BufferStore::Stats GetBufferStats() const;
 
     private:
         EventPoller(ThreadPool::Priority priority = ThreadPool::PRIORITY_HIGHEST);
 
         void RunLoop(bool blocked, bool regist_self);
 
-        void OnPipeEvent();
+        void OnWakeUpEvent();
+
+        class EventHandler;
+        void OnEvent(EventHandler *handler, int event);
+
+        void ApplyEventMask(EventHandler *handler);
+
+        void FlushEventMask();
+
+#if defined(ENABLE_IO_URING)
+        void UringPollAdd(EventHandler *handler);
+
+        void UringPollUpdate(EventHandler *handler);
+
+        void UringPollRemove(EventHandler *handler);
+
+        void OnUringCompletion(uint64_t user_data, int res, uint32_t flags);
+#endif
 
         Task::Ptr AsyncL(TaskIn task, bool may_sync = true, bool first = false);
 
@@ -68,10 +129,12 @@ namespace cyber
 
         void Shutdown();
 
-        uint64_t FlushDelayTask(uint64_t now_time);
-
         uint64_t GetMinDelay();
 
+        int PollEvents(epoll_event *events, int timeout_ms);
+
+        int WaitEvents(epoll_event *events, uint64_t min_delay);
+
     private:
         class ExitException : public std::exception
         {
@@ -80,11 +143,49 @@ namespace cyber
             ~ExitException() {}
         };
 
+        // epoll_event.data.ptr points at the handler, so dispatching needs no lookup;
+        // a deleted handler stays allocated until the end of the batch it may still appear in.
+        class EventHandler : public noncopyable
+        {
+        public:
+            EventHandler(int fd, int event, PollEventCB cb) : fd_(fd), event_(event), registered_(event), cb_(std::move(cb)) {}
+
+        public:
+            int fd_;
+            // wanted by the owner / known to the kernel
+            int event_;
+            int registered_;
+            bool alive_ = true;
+            bool dirty_ = false;
+            // io_uring only: a poll request carrying this handler is still outstanding in the kernel
+            bool armed_ = false;
+            PollEventCB cb_;
+        };
+
     private:
         std::weak_ptr<BufferRaw> shared_buffer_;
+        std::atomic<BufferStore *> buffer_store_{nullptr};
         int epoll_fd_;
-        std::mutex lock_;
-        std::unordered_map<int, std::shared_ptr<PollEventCB>> event_map_;
+        std::vector<std::unique_ptr<EventHandler>> event_table_;
+        std::vector<std::unique_ptr<EventHandler>> event_garbage_;
+        bool dispatching_ = false;
+        std::vector<EventHandler *> event_dirty_;
+        std::atomic<uint64_t> modify_avoided_{0};
+
+        int cpu_ = -1;
+        std::atomic<int> socket_count_{0};
+        std::atomic<uint64_t> loop_time_{0};
+
+        std::atomic<uint64_t> busy_poll_max_usec_{0};
+        uint64_t spin_usec_ = 0;
+
+        SlowCallbackDetector slow_callback_;
+#if defined(ENABLE_IO_URING)
+        // null when the poller runs on epoll
+        std::unique_ptr<IOUringWrap> uring_;
+        // deleted handlers whose poll request has not completed yet
+        std::vector<std::unique_ptr<EventHandler>> event_removing_;
+#endif
         bool exit_flag_;
 
         ThreadPool::Priority priority_;
@@ -93,13 +194,14 @@ namespace cyber
         std::thread::id loop_thread_id_;
         Semaphore sem_run_started_;
 
-        PipeWrap pipe_;
-        std::mutex mtx_task_;
-        List<Task::Ptr> list_task_;
+        EventFDWrap event_fd_;
+        std::atomic<bool> wakeup_pending_{false};
+        MPSCQueue<Task> task_queue_;
+        MPSCQueue<Task> task_queue_first_;
 
         Logger::Ptr logger_;
 
-        std::multimap<uint64_t, DelayTask::Ptr> delay_task_map_;
+        TimingWheel delay_task_wheel_;
     };
 
     class EventPollerPool : public std::enable_shared_from_this<EventPollerPool>, public TaskExecutorGetterImp
@@ -112,17 +214,44 @@ namespace cyber
 
         static void SetPoolSize(int size = 0);
 
+        // pin each poller created afterwards to one cpu of the process affinity mask (default on)
+        static void EnableCpuAffinity(bool enable = true);
+
+#if defined(ENABLE_IO_URING)
+        // pollers created afterwards use io_uring (the default) or epoll, a kernel without io_uring always gets epoll
+        static void EnableIOUring(bool enable = true);
+#endif
+
         EventPoller::Ptr GetFirstPoller();
 
         EventPoller::Ptr GetPoller();
 
+        typedef enum
+        {
+            // GetPoller(): the calling poller if PreferCurrentThread, else the least loaded one
+            PLACE_DEFAULT = 0,
+            // the better of two random pollers by cached load, O(1) and free of herding
+            PLACE_TWO_CHOICES,
+            // fewest live sockets, balances long lived connections rather than momentary cpu
+            PLACE_LEAST_CONNECTIONS,
+            PLACE_ROUND_ROBIN,
+            // same client ip always lands on the same poller, round robin without an address
+            PLACE_IP_HASH,
+        } PlacementPolicy;
+
+        // poller for a new connection from addr (may be null) under the given policy
+        EventPoller::Ptr GetPoller(PlacementPolicy policy, const sockaddr *addr = nullptr);
+
         void PreferCurrentThread(bool flag = true);
 
     private:
         EventPollerPool(/* args */);
 
+        EventPoller::Ptr PollerAt(size_t index);
+
     private:
         bool prefer_current_thread_ = true;
+        std::atomic<size_t> round_robin_{0};
     };
 
 } // namespace cyberweb
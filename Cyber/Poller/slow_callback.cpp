@@ -0,0 +1,71 @@
+#if !defined(CYBER_SLOW_CALLBACK_CPP)
+#define CYBER_SLOW_CALLBACK_CPP
+
+#include <cxxabi.h>
+#include <cstdlib>
+#include <string>
+
+#include "slow_callback.h"
+#include "../Util/logger.h"
+
+// at most one warning per interval, the rest are only counted
+#define SLOW_CALLBACK_REPORT_INTERVAL_MS 1000
+
+namespace cyber
+{
+    static std::string Demangle(const char *name)
+    {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        if (!demangled)
+        {
+            return name;
+        }
+        std::string ret(demangled);
+        free(demangled);
+        return ret;
+    }
+
+    SlowCallbackDetector::SlowCallbackDetector(uint64_t threshold_ms, uint32_t sample_every)
+        : threshold_us_(threshold_ms * 1000), sample_every_(sample_every ? sample_every : 1)
+    {
+    }
+
+    void SlowCallbackDetector::Set(uint64_t threshold_ms, uint32_t sample_every)
+    {
+        threshold_us_.store(threshold_ms * 1000, std::memory_order_relaxed);
+        sample_every_.store(sample_every ? sample_every : 1, std::memory_order_relaxed);
+    }
+
+    uint64_t SlowCallbackDetector::GetCount() const
+    {
+        return slow_count_.load(std::memory_order_relaxed);
+    }
+
+    void SlowCallbackDetector::Report(uint64_t cost_us, const char *kind, const std::type_info &type, int fd)
+    {
+        slow_count_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t now = GetCurrentMillisecond();
+        if (last_report_ms_ && now - last_report_ms_ < SLOW_CALLBACK_REPORT_INTERVAL_MS)
+        {
+            ++suppressed_;
+            return;
+        }
+        last_report_ms_ = now;
+        // a lambda's name carries the function it was written in, which is the call site we want
+        auto log = WarnL;
+        log << "slow " << kind << " held the EventPoller for " << cost_us / 1000 << "ms: " << Demangle(type.name());
+        if (fd != -1)
+        {
+            log << ", fd " << fd;
+        }
+        if (suppressed_)
+        {
+            log << " (" << suppressed_ << " more since the last report)";
+            suppressed_ = 0;
+        }
+    }
+
+} // namespace cyberweb
+
+#endif // CYBER_SLOW_CALLBACK_CPP
@@ -0,0 +1,70 @@
+#if !defined(CYBER_SLOW_CALLBACK_H)
+#define CYBER_SLOW_CALLBACK_H
+
+#include <atomic>
+#include <typeinfo>
+
+#include "../Util/util.h"
+
+namespace cyber
+{
+    // times one in every sample_every loop callbacks (events, async tasks, timers) and warns about
+    // those that held the loop longer than the threshold, naming the callable so the call site shows.
+    // An unsampled callback costs an increment and a compare, so it can stay on in production.
+    // Begin and End run on the loop thread only, Set may be called from anywhere.
+    class SlowCallbackDetector : public noncopyable
+    {
+    public:
+        SlowCallbackDetector(uint64_t threshold_ms, uint32_t sample_every);
+
+        // threshold_ms 0 turns the check off, sample_every 1 times every callback
+        void Set(uint64_t threshold_ms, uint32_t sample_every);
+
+        // start time of a sampled callback, 0 when this one is not timed
+        uint64_t Begin()
+        {
+            if (++counter_ < sample_every_.load(std::memory_order_relaxed))
+            {
+                return 0;
+            }
+            counter_ = 0;
+            if (!threshold_us_.load(std::memory_order_relaxed))
+            {
+                return 0;
+            }
+            uint64_t now = GetCurrentMicrosecond();
+            return now ? now : 1;
+        }
+
+        // fd is -1 for tasks and timers
+        void End(uint64_t begin, const char *kind, const std::type_info &type, int fd = -1)
+        {
+            if (!begin)
+            {
+                return;
+            }
+            uint64_t cost = GetCurrentMicrosecond() - begin;
+            if (cost >= threshold_us_.load(std::memory_order_relaxed))
+            {
+                Report(cost, kind, type, fd);
+            }
+        }
+
+        // slow callbacks seen so far, sampled ones only
+        uint64_t GetCount() const;
+
+    private:
+        void Report(uint64_t cost_us, const char *kind, const std::type_info &type, int fd);
+
+    private:
+        std::atomic<uint64_t> threshold_us_;
+        std::atomic<uint32_t> sample_every_;
+        uint32_t counter_ = 0;
+        std::atomic<uint64_t> slow_count_{0};
+        uint64_t last_report_ms_ = 0;
+        uint64_t suppressed_ = 0;
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_SLOW_CALLBACK_H
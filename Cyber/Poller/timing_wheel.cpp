@@ -0,0 +1,206 @@
+#if !defined(CYBER_TIMING_WHEEL_CPP)
+#define CYBER_TIMING_WHEEL_CPP
+
+#include "timing_wheel.h"
+#include "../Util/logger.h"
+
+#define LEVEL_SHIFT(level) (TIMING_WHEEL_ROOT_BITS + (level)*TIMING_WHEEL_LEVEL_BITS)
+#define MAX_TICKS ((1ULL << LEVEL_SHIFT(TIMING_WHEEL_LEVELS)) - 1)
+
+namespace cyber
+{
+    // first set bit at or after pos in a 256 bit map, -1 if none
+    static inline int FindRootBit(const uint64_t *bitmap, size_t pos)
+    {
+        for (size_t word = pos / 64; word < TIMING_WHEEL_ROOT_SIZE / 64; ++word)
+        {
+            uint64_t bits = bitmap[word];
+            if (word == pos / 64)
+            {
+                bits &= ~0ULL << (pos % 64);
+            }
+            if (bits)
+            {
+                return (int)(word * 64 + __builtin_ctzll(bits));
+            }
+        }
+        return -1;
+    }
+
+    TimingWheel::TimingWheel(uint64_t now) : base_(now) {}
+
+    size_t TimingWheel::Size() const
+    {
+        return size_;
+    }
+
+    void TimingWheel::SetSlowCallbackDetector(SlowCallbackDetector *detector)
+    {
+        detector_ = detector;
+    }
+
+    void TimingWheel::Add(uint64_t time_line, DelayTask::Ptr task)
+    {
+        Insert(Entry(time_line, std::move(task)));
+    }
+
+    void TimingWheel::Insert(Entry &&entry)
+    {
+        ++size_;
+        uint64_t expire = entry.time_line_ < base_ ? base_ : entry.time_line_;
+        uint64_t ticks = expire - base_;
+        if (ticks > MAX_TICKS)
+        {
+            // parked at the edge of the wheel, RunRoot puts it back until its real time line
+            ticks = MAX_TICKS;
+            expire = base_ + ticks;
+        }
+        if (ticks < TIMING_WHEEL_ROOT_SIZE)
+        {
+            size_t index = expire & (TIMING_WHEEL_ROOT_SIZE - 1);
+            root_[index].emplace_back(std::move(entry));
+            root_bitmap_[index / 64] |= 1ULL << (index % 64);
+            return;
+        }
+        for (int level = 0; level < TIMING_WHEEL_LEVELS; ++level)
+        {
+            if (ticks < (1ULL << LEVEL_SHIFT(level + 1)))
+            {
+                size_t index = (expire >> LEVEL_SHIFT(level)) & (TIMING_WHEEL_LEVEL_SIZE - 1);
+                levels_[level][index].emplace_back(std::move(entry));
+                level_bitmap_[level] |= 1ULL << index;
+                return;
+            }
+        }
+    }
+
+    void TimingWheel::Cascade(int level, size_t index)
+    {
+        if (!(level_bitmap_[level] & (1ULL << index)))
+        {
+            return;
+        }
+        Slot slot;
+        slot.swap(levels_[level][index]);
+        level_bitmap_[level] &= ~(1ULL << index);
+        size_ -= slot.size();
+        for (auto &entry : slot)
+        {
+            if (*entry.task_)
+            {
+                Insert(std::move(entry));
+            }
+        }
+    }
+
+    void TimingWheel::RunRoot(size_t index, uint64_t now)
+    {
+        Slot slot;
+        slot.swap(root_[index]);
+        root_bitmap_[index / 64] &= ~(1ULL << (index % 64));
+        size_ -= slot.size();
+        for (auto &entry : slot)
+        {
+            if (!*entry.task_)
+            {
+                continue;
+            }
+            if (entry.time_line_ > base_)
+            {
+                Insert(std::move(entry));
+                continue;
+            }
+            uint64_t begin = detector_ ? detector_->Begin() : 0;
+            try
+            {
+                auto next_delay = (*entry.task_)();
+                if (begin)
+                {
+                    detector_->End(begin, "timer", entry.task_->TargetType());
+                }
+                if (next_delay)
+                {
+                    Insert(Entry(next_delay + now, std::move(entry.task_)));
+                }
+            }
+            catch (const std::exception &e)
+            {
+                ErrorL << "EventPoller execute delay task error: " << e.what() << '\n';
+            }
+        }
+    }
+
+    uint64_t TimingWheel::Flush(uint64_t now)
+    {
+        while (size_ && base_ <= now)
+        {
+            size_t index = base_ & (TIMING_WHEEL_ROOT_SIZE - 1);
+            if (!index)
+            {
+                for (int level = 0; level < TIMING_WHEEL_LEVELS; ++level)
+                {
+                    size_t level_index = (base_ >> LEVEL_SHIFT(level)) & (TIMING_WHEEL_LEVEL_SIZE - 1);
+                    Cascade(level, level_index);
+                    if (level_index)
+                    {
+                        break;
+                    }
+                }
+            }
+            RunRoot(index, now);
+            if (root_bitmap_[index / 64] & (1ULL << (index % 64)))
+            {
+                // something due at this very tick was added while running the slot
+                continue;
+            }
+            uint64_t next = size_ ? NextTick() : now + 1;
+            base_ = next > now ? now + 1 : (next > base_ ? next : base_ + 1);
+        }
+        if (base_ <= now)
+        {
+            base_ = now + 1;
+        }
+        if (!size_)
+        {
+            return 0;
+        }
+        return NextTick() - now;
+    }
+
+    uint64_t TimingWheel::NextTick() const
+    {
+        uint64_t ret = UINT64_MAX;
+        uint64_t round = base_ & ~(uint64_t)(TIMING_WHEEL_ROOT_SIZE - 1);
+        int pos = FindRootBit(root_bitmap_, base_ & (TIMING_WHEEL_ROOT_SIZE - 1));
+        if (pos != -1)
+        {
+            ret = round + pos;
+        }
+        else if ((pos = FindRootBit(root_bitmap_, 0)) != -1)
+        {
+            ret = round + TIMING_WHEEL_ROOT_SIZE + pos;
+        }
+        for (int level = 0; level < TIMING_WHEEL_LEVELS; ++level)
+        {
+            uint64_t bitmap = level_bitmap_[level];
+            if (!bitmap)
+            {
+                continue;
+            }
+            // a level slot is cascaded on the first tick aligned to its span whose index matches
+            int shift = LEVEL_SHIFT(level);
+            uint64_t start = (base_ + (1ULL << shift) - 1) >> shift;
+            int offset = start & (TIMING_WHEEL_LEVEL_SIZE - 1);
+            uint64_t rotated = (bitmap >> offset) | (offset ? bitmap << (TIMING_WHEEL_LEVEL_SIZE - offset) : 0);
+            uint64_t tick = (start + __builtin_ctzll(rotated)) << shift;
+            if (tick < ret)
+            {
+                ret = tick;
+            }
+        }
+        return ret;
+    }
+
+} // namespace cyberweb
+
+#endif // CYBER_TIMING_WHEEL_CPP
@@ -0,0 +1,68 @@
+#if !defined(CYBER_TIMING_WHEEL_H)
+#define CYBER_TIMING_WHEEL_H
+
+#include <vector>
+#include <memory>
+
+#include "../Thread/task_executor.h"
+#include "slow_callback.h"
+
+#define TIMING_WHEEL_ROOT_BITS 8
+#define TIMING_WHEEL_LEVEL_BITS 6
+#define TIMING_WHEEL_LEVELS 4
+#define TIMING_WHEEL_ROOT_SIZE (1 << TIMING_WHEEL_ROOT_BITS)
+#define TIMING_WHEEL_LEVEL_SIZE (1 << TIMING_WHEEL_LEVEL_BITS)
+
+namespace cyber
+{
+    typedef TaskCancelableImp<uint64_t(void)> DelayTask;
+
+    // hierarchical timing wheel with a 1ms tick: a 256 slot root wheel and 4 levels of 64 slots,
+    // which covers 2^32 ms. Insert is O(1), cancelled tasks are dropped when their slot comes up,
+    // and the next deadline is found from the slot bitmaps without walking any slot.
+    class TimingWheel : public noncopyable
+    {
+    public:
+        TimingWheel(uint64_t now);
+        ~TimingWheel() {}
+
+        void Add(uint64_t time_line, DelayTask::Ptr task);
+
+        // run every task due at now, return ms until the wheel needs attention again, 0 if it is empty
+        uint64_t Flush(uint64_t now);
+
+        size_t Size() const;
+
+        // time the tasks run by Flush, null to stop
+        void SetSlowCallbackDetector(SlowCallbackDetector *detector);
+
+    private:
+        class Entry
+        {
+        public:
+            Entry(uint64_t time_line, DelayTask::Ptr task) : time_line_(time_line), task_(std::move(task)) {}
+
+        public:
+            uint64_t time_line_;
+            DelayTask::Ptr task_;
+        };
+        typedef std::vector<Entry> Slot;
+
+        void Insert(Entry &&entry);
+        void Cascade(int level, size_t index);
+        void RunRoot(size_t index, uint64_t now);
+        uint64_t NextTick() const;
+
+    private:
+        uint64_t base_;
+        size_t size_ = 0;
+        Slot root_[TIMING_WHEEL_ROOT_SIZE];
+        uint64_t root_bitmap_[TIMING_WHEEL_ROOT_SIZE / 64] = {0};
+        Slot levels_[TIMING_WHEEL_LEVELS][TIMING_WHEEL_LEVEL_SIZE];
+        uint64_t level_bitmap_[TIMING_WHEEL_LEVELS] = {0};
+        SlowCallbackDetector *detector_ = nullptr;
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_TIMING_WHEEL_H
@@ -1,26 +1,435 @@
 #if !defined(CYBER_BUFFER_CPP)
 #define CYBER_BUFFER_CPP
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cassert>
 #include <sys/uio.h>
+#include <netinet/udp.h>
 
 #include "../Util/util.h"
+#include "../Util/uv_errno.h"
 #include "buffer.h"
 #include "../Util/logger.h"
 
+#if !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+#if !defined(MSG_ZEROCOPY)
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// kernel limits of one segmented send (UDP_MAX_SEGMENTS and the ip payload)
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_BYTES 65000
+#define UDP_SEND_BATCH 64
+
 namespace cyber
 {
+    // a BufferStore block: the header sits right before what Alloc hands out
+    struct BufferStore::Block
+    {
+        // nullptr for heap blocks
+        BufferStore *store;
+        size_t klass;
+    };
+
+    // the free list links through the first bytes of the free blocks
+#define BLOCK_NEXT(block) (*(BufferStore::Block **)((block) + 1))
+    // blocks have 16 bytes of slack, so a power of two size plus its terminating 0 keeps to its class
+#define BLOCK_SLACK 16
+
+    static thread_local BufferStore *s_store = nullptr;
+
+    static inline size_t ClassSize(size_t klass)
+    {
+        return ((size_t)1 << (klass + BUFFER_STORE_MIN_SHIFT)) + BLOCK_SLACK;
+    }
+
+    void *BufferStore::Alloc(size_t size)
+    {
+        auto store = s_store;
+        if (store && size <= ClassSize(kClasses - 1))
+        {
+            size_t klass = 0;
+            while (ClassSize(klass) < size)
+            {
+                ++klass;
+            }
+            return store->AllocL(klass);
+        }
+        if (store)
+        {
+            store->oversize_.store(store->oversize_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        auto block = (Block *)malloc(sizeof(Block) + size);
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+        block->store = nullptr;
+        return block + 1;
+    }
+
+    void BufferStore::Free(void *ptr)
+    {
+        if (!ptr)
+        {
+            return;
+        }
+        auto block = (Block *)ptr - 1;
+        auto store = block->store;
+        if (!store)
+        {
+            free(block);
+        }
+        else if (store == s_store)
+        {
+            store->FreeL(block);
+        }
+        else
+        {
+            store->FreeRemote(block);
+        }
+    }
+
+    BufferStore *BufferStore::Attach()
+    {
+        if (!s_store)
+        {
+            s_store = new BufferStore;
+        }
+        return s_store;
+    }
+
+    void BufferStore::Detach()
+    {
+        auto store = s_store;
+        if (!store)
+        {
+            return;
+        }
+        s_store = nullptr;
+        for (size_t klass = 0; klass < kClasses; ++klass)
+        {
+            while (auto block = store->free_[klass])
+            {
+                store->free_[klass] = BLOCK_NEXT(block);
+                free(block);
+            }
+            store->free_count_[klass] = 0;
+        }
+        bool last;
+        {
+            // blocks still out are freed to the heap from now on, the last one deletes the store
+            std::lock_guard<std::mutex> lock(store->remote_mtx_);
+            store->closed_ = true;
+            while (auto block = store->remote_)
+            {
+                store->remote_ = BLOCK_NEXT(block);
+                free(block);
+                --store->outstanding_;
+            }
+            store->orphans_ = store->outstanding_;
+            last = !store->orphans_;
+        }
+        if (last)
+        {
+            delete store;
+        }
+    }
+
+    BufferStore::~BufferStore() {}
+
+    BufferStore::Stats BufferStore::GetStats() const
+    {
+        Stats stats;
+        stats.hits = hits_.load(std::memory_order_relaxed);
+        stats.misses = misses_.load(std::memory_order_relaxed);
+        stats.remote_frees = remote_frees_.load(std::memory_order_relaxed);
+        stats.oversize = oversize_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void *BufferStore::AllocL(size_t klass)
+    {
+        if (!free_[klass] && remote_count_.load(std::memory_order_relaxed))
+        {
+            DrainRemote();
+        }
+        ++outstanding_;
+        auto block = free_[klass];
+        if (block)
+        {
+            free_[klass] = BLOCK_NEXT(block);
+            --free_count_[klass];
+            hits_.store(hits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return block + 1;
+        }
+        misses_.store(misses_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        block = (Block *)malloc(sizeof(Block) + ClassSize(klass));
+        if (!block)
+        {
+            --outstanding_;
+            throw std::bad_alloc();
+        }
+        block->store = this;
+        block->klass = klass;
+        return block + 1;
+    }
+
+    void BufferStore::FreeL(Block *block)
+    {
+        --outstanding_;
+        auto klass = block->klass;
+        if (free_count_[klass] * ClassSize(klass) >= BUFFER_STORE_CLASS_BYTES && free_count_[klass] >= 4)
+        {
+            free(block);
+            return;
+        }
+        BLOCK_NEXT(block) = free_[klass];
+        free_[klass] = block;
+        ++free_count_[klass];
+    }
+
+    void BufferStore::FreeRemote(Block *block)
+    {
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(remote_mtx_);
+            if (!closed_)
+            {
+                BLOCK_NEXT(block) = remote_;
+                remote_ = block;
+                remote_count_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            free(block);
+            last = !--orphans_;
+        }
+        if (last)
+        {
+            delete this;
+        }
+    }
+
+    void BufferStore::DrainRemote()
+    {
+        Block *block;
+        {
+            std::lock_guard<std::mutex> lock(remote_mtx_);
+            block = remote_;
+            remote_ = nullptr;
+            remote_count_.store(0, std::memory_order_relaxed);
+        }
+        size_t count = 0;
+        while (block)
+        {
+            auto next = BLOCK_NEXT(block);
+            FreeL(block);
+            block = next;
+            ++count;
+        }
+        remote_frees_.store(remote_frees_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
     BufferRaw::Ptr BufferRaw::Create()
     {
-        return Ptr(new BufferRaw);
+        return std::allocate_shared<BufferRaw>(BufferAllocator<BufferRaw>());
+    }
+
+    BufferChain::Segment BufferChain::MakeSegment(const Buffer::Ptr &buf, size_t offset, size_t len)
+    {
+        if (offset > buf->Size())
+        {
+            throw std::out_of_range("BufferChain offset out of range");
+        }
+        if (!len || len > buf->Size() - offset)
+        {
+            len = buf->Size() - offset;
+        }
+        return Segment{buf, offset, len};
+    }
+
+    void BufferChain::Append(const Buffer::Ptr &buf, size_t offset, size_t len)
+    {
+        auto segment = MakeSegment(buf, offset, len);
+        if (segment.size)
+        {
+            size_ += segment.size;
+            segments_.emplace_back(std::move(segment));
+        }
+    }
+
+    void BufferChain::Prepend(const Buffer::Ptr &buf, size_t offset, size_t len)
+    {
+        auto segment = MakeSegment(buf, offset, len);
+        if (segment.size)
+        {
+            size_ += segment.size;
+            segments_.emplace_front(std::move(segment));
+        }
+    }
+
+    void BufferChain::Append(const char *data, size_t len)
+    {
+        if (!len)
+        {
+            return;
+        }
+        size_ += len;
+        if (tail_ && !segments_.empty())
+        {
+            // grow the last segment when it ends where the tail buffer's bytes do
+            auto &last = segments_.back();
+            size_t used = tail_->Size();
+            if (last.buf == tail_ && last.offset + last.size == used && tail_->GetCapacity() - used > len)
+            {
+                memcpy(tail_->Data() + used, data, len);
+                tail_->SetSize(used + len);
+                last.size += len;
+                return;
+            }
+        }
+        tail_ = BufferRaw::Create();
+        tail_->SetCapacity(std::max(len, (size_t)BUFFER_CHAIN_BLOCK_SIZE) + 1);
+        memcpy(tail_->Data(), data, len);
+        tail_->SetSize(len);
+        segments_.emplace_back(Segment{tail_, 0, len});
+    }
+
+    void BufferChain::Append(BufferChain &&that)
+    {
+        for (auto &segment : that.segments_)
+        {
+            segments_.emplace_back(std::move(segment));
+        }
+        if (!that.segments_.empty())
+        {
+            // the last segment is that's now
+            tail_ = std::move(that.tail_);
+        }
+        size_ += that.size_;
+        that.Clear();
+    }
+
+    void BufferChain::TrimStart(size_t n)
+    {
+        if (n > size_)
+        {
+            throw std::out_of_range("BufferChain::TrimStart out of range");
+        }
+        size_ -= n;
+        while (n)
+        {
+            auto &first = segments_.front();
+            if (n < first.size)
+            {
+                first.offset += n;
+                first.size -= n;
+                return;
+            }
+            n -= first.size;
+            segments_.pop_front();
+        }
+    }
+
+    void BufferChain::TrimEnd(size_t n)
+    {
+        if (n > size_)
+        {
+            throw std::out_of_range("BufferChain::TrimEnd out of range");
+        }
+        size_ -= n;
+        while (n)
+        {
+            auto &last = segments_.back();
+            if (n < last.size)
+            {
+                last.size -= n;
+                return;
+            }
+            n -= last.size;
+            segments_.pop_back();
+        }
+    }
+
+    BufferChain BufferChain::Split(size_t n)
+    {
+        if (n > size_)
+        {
+            throw std::out_of_range("BufferChain::Split out of range");
+        }
+        BufferChain ret;
+        ret.size_ = n;
+        size_ -= n;
+        while (n)
+        {
+            auto &first = segments_.front();
+            if (n < first.size)
+            {
+                ret.segments_.emplace_back(Segment{first.buf, first.offset, n});
+                first.offset += n;
+                first.size -= n;
+                break;
+            }
+            n -= first.size;
+            ret.segments_.emplace_back(std::move(first));
+            segments_.pop_front();
+        }
+        return ret;
+    }
+
+    void BufferChain::Clear()
+    {
+        size_ = 0;
+        segments_.clear();
+        tail_ = nullptr;
+    }
+
+    size_t BufferChain::ToIovec(iovec *iov, size_t max) const
+    {
+        size_t count = std::min(max, segments_.size());
+        for (size_t i = 0; i < count; ++i)
+        {
+            iov[i].iov_base = segments_[i].buf->Data() + segments_[i].offset;
+            iov[i].iov_len = segments_[i].size;
+        }
+        return count;
+    }
+
+    std::vector<Buffer::Ptr> BufferChain::ToBuffers() const
+    {
+        std::vector<Buffer::Ptr> ret;
+        ret.reserve(segments_.size());
+        for (auto &segment : segments_)
+        {
+            // whole buffers go as they are, but the tail buffer may still grow
+            if (!segment.offset && segment.size == segment.buf->Size() && segment.buf != tail_)
+            {
+                ret.emplace_back(segment.buf);
+                continue;
+            }
+            ret.emplace_back(std::make_shared<BufferSlice>(segment.buf, segment.offset, segment.size));
+        }
+        return ret;
+    }
+
+    std::string BufferChain::ToString() const
+    {
+        std::string ret;
+        ret.reserve(size_);
+        ForEach([&](const char *data, size_t len)
+                { ret.append(data, len); });
+        return ret;
     }
 
     BufferSock::BufferSock(Buffer::Ptr buffer, sockaddr *addr, int addr_len, OnResult cb)
     {
         if (addr && addr_len)
         {
-            addr_ = (sockaddr *)malloc(addr_len);
+            addr_ = (sockaddr *)BufferStore::Alloc(addr_len);
+            memcpy(addr_, addr, addr_len);
             addr_len_ = addr_len;
         }
         assert(buffer);
@@ -30,10 +439,7 @@ namespace cyber
 
     BufferSock::~BufferSock()
     {
-        if (addr_)
-        {
-            free(addr_);
-        }
+        BufferStore::Free(addr_);
         if (result_)
         {
             result_(0);
@@ -41,6 +447,11 @@ namespace cyber
         }
     }
 
+    BufferSock::Ptr BufferSock::Create(Buffer::Ptr buffer, sockaddr *addr, int addr_len, OnResult cb)
+    {
+        return std::allocate_shared<BufferSock>(BufferAllocator<BufferSock>(), std::move(buffer), addr, addr_len, std::move(cb));
+    }
+
     char *BufferSock::Data() const
     {
         return buffer_->Data();
@@ -65,7 +476,7 @@ namespace cyber
         }
     }
 
-    BufferList::BufferList(List<BufferSock::Ptr> &list) : iovec_(list.size())
+    BufferList::BufferList(List<BufferSock::Ptr> &list, bool udp, bool udp_gso, size_t zerocopy_min_size) : udp_(udp), iovec_(list.size())
     {
         pkt_list_.swap(list);
         auto it = iovec_.begin();
@@ -77,6 +488,72 @@ namespace cyber
                 remain_size_ += it->iov_len;
                 ++it;
             });
+        if (udp_)
+        {
+            BuildMessages(udp_gso);
+        }
+        zerocopy_ = !udp_ && zerocopy_min_size && remain_size_ >= zerocopy_min_size;
+    }
+
+    BufferList::Ptr BufferList::Create(List<BufferSock::Ptr> &list, bool udp, bool udp_gso, size_t zerocopy_min_size)
+    {
+        return std::allocate_shared<BufferList>(BufferAllocator<BufferList>(), list, udp, udp_gso, zerocopy_min_size);
+    }
+
+    void BufferList::BuildMessages(bool udp_gso)
+    {
+        std::vector<BufferSock::Ptr *> pkts;
+        pkts.reserve(iovec_.size());
+        pkt_list_.ForEach(
+            [&](BufferSock::Ptr &buffer)
+            { pkts.emplace_back(&buffer); });
+
+        auto same_address = [](const BufferSock::Ptr &a, const BufferSock::Ptr &b)
+        {
+            return a->addr_len_ == b->addr_len_ && (!a->addr_len_ || memcmp(a->addr_, b->addr_, a->addr_len_) == 0);
+        };
+        size_t cmsg_space = CMSG_SPACE(sizeof(uint16_t));
+        if (udp_gso)
+        {
+            control_.resize(pkts.size() * cmsg_space);
+        }
+        msgs_.reserve(pkts.size());
+        for (size_t i = 0; i < pkts.size();)
+        {
+            // every datagram of a run but the last one must be exactly segment bytes
+            size_t count = 1;
+            size_t segment = iovec_[i].iov_len;
+            size_t total = segment;
+            while (udp_gso && i + count < pkts.size() && count < UDP_GSO_MAX_SEGMENTS &&
+                   iovec_[i + count - 1].iov_len == segment && iovec_[i + count].iov_len <= segment &&
+                   total + iovec_[i + count].iov_len <= UDP_GSO_MAX_BYTES && same_address(*pkts[i], *pkts[i + count]))
+            {
+                total += iovec_[i + count].iov_len;
+                ++count;
+            }
+
+            mmsghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            auto &pkt = *pkts[i];
+            msg.msg_hdr.msg_name = pkt->addr_;
+            msg.msg_hdr.msg_namelen = pkt->addr_len_;
+            msg.msg_hdr.msg_iov = &iovec_[i];
+            msg.msg_hdr.msg_iovlen = count;
+            if (count > 1)
+            {
+                msg.msg_hdr.msg_control = control_.data() + msgs_.size() * cmsg_space;
+                msg.msg_hdr.msg_controllen = cmsg_space;
+                auto cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = (uint16_t)segment;
+                memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            }
+            msgs_.emplace_back(msg);
+            msg_counts_.emplace_back(count);
+            i += count;
+        }
     }
 
     bool BufferList::Empty() const
@@ -84,13 +561,50 @@ namespace cyber
         return iovec_off_ == iovec_.size();
     }
 
+    bool BufferList::GsoFailed() const
+    {
+        return gso_failed_;
+    }
+
     size_t BufferList::Count() const
     {
         return iovec_.size() - iovec_off_;
     }
 
+    size_t BufferList::RemainSize() const
+    {
+        return remain_size_;
+    }
+
+    uint32_t BufferList::ZeroCopySends() const
+    {
+        return zerocopy_sends_;
+    }
+
+    void BufferList::OnZeroCopyDone()
+    {
+        zerocopy_held_.ForEach(
+            [](BufferSock::Ptr &buffer)
+            { buffer->OnSendSuccess(); });
+        zerocopy_held_.clear();
+    }
+
+    void BufferList::OnSent(BufferSock::Ptr &buffer)
+    {
+        if (zerocopy_sends_)
+        {
+            zerocopy_held_.emplace_back(std::move(buffer));
+            return;
+        }
+        buffer->OnSendSuccess();
+    }
+
     ssize_t BufferList::Send(int fd, int flags)
     {
+        if (udp_)
+        {
+            return SendUdp(fd, flags);
+        }
         auto remain_size = remain_size_;
         while (remain_size_ && SendL(fd, flags) != -1)
             ;
@@ -117,6 +631,7 @@ namespace cyber
             }
             size_t remain = offset - n;
             ref.iov_base = (char *)ref.iov_base + ref.iov_len - remain;
+            ref.iov_len = (decltype(ref.iov_len))remain;
             iovec_off_ = i;
             if (remain == 0)
             {
@@ -126,8 +641,7 @@ namespace cyber
         }
         for (int i = last_off; i < iovec_off_; i++)
         {
-            auto &front = pkt_list_.front();
-            front->OnSendSuccess();
+            OnSent(pkt_list_.front());
             pkt_list_.pop_front();
         }
     }
@@ -155,17 +669,28 @@ namespace cyber
             msg.msg_control = NULL;
             msg.msg_controllen = 0;
 
-            n = sendmsg(fd, &msg, flags);
+            n = sendmsg(fd, &msg, zerocopy_ ? flags | MSG_ZEROCOPY : flags);
+            if (n == -1 && zerocopy_ && errno == ENOBUFS)
+            {
+                // out of optmem for the pinned pages, copy like any other send
+                zerocopy_ = false;
+                n = sendmsg(fd, &msg, flags);
+            }
+            if (n > 0 && zerocopy_)
+            {
+                ++zerocopy_sends_;
+            }
 
-        } while (n == -1);
+        } while (n == -1 && UV_EINTR == get_uv_error(true));
 
         if (n >= (ssize_t)remain_size_)
         {
             iovec_off_ = iovec_.size();
             remain_size_ = 0;
             pkt_list_.ForEach(
-                [](BufferSock::Ptr &buffer)
-                { buffer->OnSendSuccess(); });
+                [&](BufferSock::Ptr &buffer)
+                { OnSent(buffer); });
+            pkt_list_.clear();
             return n;
         }
 
@@ -177,6 +702,63 @@ namespace cyber
         return n;
     }
 
+    size_t BufferList::PopDatagrams(size_t msg, bool success)
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < msg_counts_[msg]; ++i)
+        {
+            auto &front = pkt_list_.front();
+            bytes += front->Size();
+            if (success)
+            {
+                front->OnSendSuccess();
+            }
+            pkt_list_.pop_front();
+        }
+        iovec_off_ += msg_counts_[msg];
+        remain_size_ -= bytes;
+        return bytes;
+    }
+
+    ssize_t BufferList::SendUdp(int fd, int flags)
+    {
+        ssize_t sent = 0;
+        while (msg_off_ < msgs_.size())
+        {
+            int n;
+            do
+            {
+                n = sendmmsg(fd, &msgs_[msg_off_], (unsigned int)std::min(msgs_.size() - msg_off_, (size_t)UDP_SEND_BATCH), flags);
+            } while (n == -1 && UV_EINTR == get_uv_error(true));
+
+            if (n > 0)
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    sent += PopDatagrams(msg_off_++, true);
+                }
+                continue;
+            }
+            int err = get_uv_error(true);
+            if (err == UV_EAGAIN)
+            {
+                break;
+            }
+            // a datagram the kernel rejects (unreachable peer, too large) is dropped, the socket stays usable
+            if (msg_counts_[msg_off_] > 1 && (err == UV_EIO || err == UV_EINVAL))
+            {
+                gso_failed_ = true;
+            }
+            WarnL << "udp send failed, drop " << msg_counts_[msg_off_] << " datagram(s): " << uv_strerror(err);
+            PopDatagrams(msg_off_++, false);
+        }
+        if (sent > 0 || Empty())
+        {
+            return sent;
+        }
+        return -1;
+    }
+
 } // namespace cyberweb
 
 #endif // CYBER_BUFFER_CPP
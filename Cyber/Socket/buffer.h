@@ -1,19 +1,126 @@
 #if !defined(CYBER_BUFFER_H)
 #define CYBER_BUFFER_H
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
 #include <functional>
 #include <arpa/inet.h>
+#include <deque>
 #include <vector>
 #include <list>
 #include <string.h>
+#include <sys/socket.h>
 
 #include "../Util/util.h"
 #include "../Util/logger.h"
 
+// block sizes a BufferStore caches, 64B to 1MB in powers of two, and the free bytes it keeps of each
+#define BUFFER_STORE_MIN_SHIFT 6
+#define BUFFER_STORE_MAX_SHIFT 20
+#define BUFFER_STORE_CLASS_BYTES (2 * 1024 * 1024)
+// the smallest buffer BufferChain copies bytes into
+#define BUFFER_CHAIN_BLOCK_SIZE 4096
+
 namespace cyber
 {
+    // thread local cache of fixed size blocks, for buffer storage and buffer objects. Each poller
+    // thread has one (EventPoller attaches it), other threads use the heap. A block freed on
+    // another thread goes back to the store it came from, or to the heap once that store is detached
+    class BufferStore : public noncopyable
+    {
+    public:
+        struct Stats
+        {
+            // served from the cache / from the heap
+            uint64_t hits;
+            uint64_t misses;
+            // freed on another thread and returned
+            uint64_t remote_frees;
+            // larger than the largest block
+            uint64_t oversize;
+        };
+
+        // room for at least size bytes
+        static void *Alloc(size_t size);
+        static void Free(void *ptr);
+
+        // give the calling thread a store, Detach it (on the same thread) before the thread ends
+        static BufferStore *Attach();
+        static void Detach();
+
+        Stats GetStats() const;
+
+    private:
+        struct Block;
+        BufferStore() {}
+        ~BufferStore();
+        void *AllocL(size_t klass);
+        void FreeL(Block *block);
+        void FreeRemote(Block *block);
+        void DrainRemote();
+
+    private:
+        static const size_t kClasses = BUFFER_STORE_MAX_SHIFT - BUFFER_STORE_MIN_SHIFT + 1;
+        // the owner thread's side
+        Block *free_[kClasses] = {};
+        size_t free_count_[kClasses] = {};
+        size_t outstanding_ = 0;
+        // written by the owner only
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+        std::atomic<uint64_t> remote_frees_{0};
+        std::atomic<uint64_t> oversize_{0};
+        // frees from other threads, and what is still out once the owner detached
+        std::mutex remote_mtx_;
+        Block *remote_ = nullptr;
+        std::atomic<size_t> remote_count_{0};
+        bool closed_ = false;
+        size_t orphans_ = 0;
+    };
+
+    // std allocator over BufferStore, for std::allocate_shared of buffer objects and their containers
+    template <typename T>
+    class BufferAllocator
+    {
+    public:
+        typedef T value_type;
+        BufferAllocator() {}
+        template <typename U>
+        BufferAllocator(const BufferAllocator<U> &) {}
+
+        T *allocate(size_t n)
+        {
+            return static_cast<T *>(BufferStore::Alloc(n * sizeof(T)));
+        }
+        void deallocate(T *ptr, size_t)
+        {
+            BufferStore::Free(ptr);
+        }
+        // buffers with a protected constructor befriend the allocator
+        template <typename U, typename... Args>
+        void construct(U *ptr, Args &&...args)
+        {
+            ::new ((void *)ptr) U(std::forward<Args>(args)...);
+        }
+        template <typename U>
+        void destroy(U *ptr)
+        {
+            ptr->~U();
+        }
+        template <typename U>
+        bool operator==(const BufferAllocator<U> &) const
+        {
+            return true;
+        }
+        template <typename U>
+        bool operator!=(const BufferAllocator<U> &) const
+        {
+            return false;
+        }
+    };
+
     class Buffer : public noncopyable
     {
     public:
@@ -38,9 +145,14 @@ namespace cyber
     class BufferRaw : public Buffer
     {
     public:
+        template <typename>
+        friend class BufferAllocator;
         using Ptr = std::shared_ptr<BufferRaw>;
         static Ptr Create();
-        ~BufferRaw() override{};
+        ~BufferRaw() override
+        {
+            BufferStore::Free(data_);
+        };
         char *Data() const override
         {
             return data_;
@@ -64,9 +176,9 @@ namespace cyber
                         return;
                     }
                 } while (false);
-                delete[] data_;
+                BufferStore::Free(data_);
             }
-            data_ = new char[capacity];
+            data_ = (char *)BufferStore::Alloc(capacity);
             capacity_ = capacity;
         }
         void SetSize(size_t size)
@@ -112,6 +224,151 @@ namespace cyber
         char *data_ = nullptr;
     };
 
+    // takes over a moved-in container (std::string, std::vector<char>) and exposes a window of it
+    template <typename C>
+    class BufferOffset : public Buffer
+    {
+    public:
+        typedef std::shared_ptr<BufferOffset> Ptr;
+        BufferOffset(C data, size_t offset = 0, size_t len = 0) : data_(std::move(data))
+        {
+            if (offset > data_.size())
+            {
+                throw std::out_of_range("BufferOffset offset out of range");
+            }
+            if (!len || len > data_.size() - offset)
+            {
+                len = data_.size() - offset;
+            }
+            offset_ = offset;
+            size_ = len;
+        }
+        ~BufferOffset() override {}
+        char *Data() const override
+        {
+            return const_cast<char *>(data_.data()) + offset_;
+        }
+        size_t Size() const override
+        {
+            return size_;
+        }
+        size_t GetCapacity() const override
+        {
+            return data_.capacity();
+        }
+
+    private:
+        C data_;
+        size_t offset_;
+        size_t size_;
+    };
+
+    typedef BufferOffset<std::string> BufferString;
+    typedef BufferOffset<std::vector<char>> BufferVector;
+
+    // part of another buffer, which it keeps alive. Many slices may share one parent
+    class BufferSlice : public Buffer
+    {
+    public:
+        typedef std::shared_ptr<BufferSlice> Ptr;
+        BufferSlice(Buffer::Ptr parent, size_t offset = 0, size_t len = 0) : parent_(std::move(parent))
+        {
+            if (offset > parent_->Size())
+            {
+                throw std::out_of_range("BufferSlice offset out of range");
+            }
+            if (!len || len > parent_->Size() - offset)
+            {
+                len = parent_->Size() - offset;
+            }
+            offset_ = offset;
+            size_ = len;
+        }
+        ~BufferSlice() override {}
+        char *Data() const override
+        {
+            return parent_->Data() + offset_;
+        }
+        size_t Size() const override
+        {
+            return size_;
+        }
+
+    private:
+        Buffer::Ptr parent_;
+        size_t offset_;
+        size_t size_;
+    };
+
+    // a byte stream kept as a chain of segments, each a window of a shared Buffer. Appending,
+    // prepending and trimming either end move no bytes, and each segment is one iovec
+    class BufferChain
+    {
+    public:
+        BufferChain() {}
+        BufferChain(BufferChain &&that) = default;
+        BufferChain &operator=(BufferChain &&that) = default;
+        BufferChain(const BufferChain &that) = delete;
+        BufferChain &operator=(const BufferChain &that) = delete;
+
+        size_t Size() const
+        {
+            return size_;
+        }
+        bool Empty() const
+        {
+            return !size_;
+        }
+        size_t Count() const
+        {
+            return segments_.size();
+        }
+
+        // reference [offset, offset + len) of buf, len 0 meaning up to its end
+        void Append(const Buffer::Ptr &buf, size_t offset = 0, size_t len = 0);
+        void Prepend(const Buffer::Ptr &buf, size_t offset = 0, size_t len = 0);
+        // copy the bytes in, into the spare room of the chain's own last buffer when there is some
+        void Append(const char *data, size_t len);
+        // take over that's segments
+        void Append(BufferChain &&that);
+        // drop n bytes from the front / the back
+        void TrimStart(size_t n);
+        void TrimEnd(size_t n);
+        // the first n bytes as a chain of their own, this one keeps the rest
+        BufferChain Split(size_t n);
+        void Clear();
+
+        // fun(const char *data, size_t len) for each segment, in order
+        template <typename FUN>
+        void ForEach(FUN &&fun) const
+        {
+            for (auto &segment : segments_)
+            {
+                fun(segment.buf->Data() + segment.offset, segment.size);
+            }
+        }
+        // fills up to max iovecs, returns how many
+        size_t ToIovec(iovec *iov, size_t max) const;
+        // a Buffer per segment, for Socket::SendV
+        std::vector<Buffer::Ptr> ToBuffers() const;
+        std::string ToString() const;
+
+    private:
+        struct Segment
+        {
+            Buffer::Ptr buf;
+            size_t offset;
+            size_t size;
+        };
+        Segment MakeSegment(const Buffer::Ptr &buf, size_t offset, size_t len);
+
+    private:
+        size_t size_ = 0;
+        std::deque<Segment> segments_;
+        // written by Append(data, len) only, its bytes past Size() are spare room
+        BufferRaw::Ptr tail_;
+    };
+
     class BufferList;
     class BufferSock : public Buffer
     {
@@ -122,6 +379,8 @@ namespace cyber
 
         BufferSock(Buffer::Ptr buffer, sockaddr *addr = nullptr, int addr_len = 0, OnResult cb = nullptr);
         ~BufferSock();
+        // allocated from the calling thread's BufferStore
+        static Ptr Create(Buffer::Ptr buffer, sockaddr *addr = nullptr, int addr_len = 0, OnResult cb = nullptr);
 
         char *Data() const override;
         size_t Size() const override;
@@ -140,22 +399,51 @@ namespace cyber
     {
     public:
         typedef std::shared_ptr<BufferList> Ptr;
-        BufferList(List<BufferSock::Ptr> &list);
+        // udp keeps every buffer a datagram of its own, udp_gso merges runs of equal sized
+        // datagrams to one peer into a single UDP_SEGMENT send
+        // tcp sends MSG_ZEROCOPY when zerocopy_min_size (0 never) or more bytes are queued
+        BufferList(List<BufferSock::Ptr> &list, bool udp = false, bool udp_gso = false, size_t zerocopy_min_size = 0);
         ~BufferList() {}
+        // allocated from the calling thread's BufferStore
+        static Ptr Create(List<BufferSock::Ptr> &list, bool udp = false, bool udp_gso = false, size_t zerocopy_min_size = 0);
 
         bool Empty() const;
         size_t Count() const;
+        // bytes not sent (nor dropped) yet
+        size_t RemainSize() const;
         ssize_t Send(int fd, int flags);
+        // the kernel refused a segmented send, the socket should stop asking for gso
+        bool GsoFailed() const;
+        // sendmsg calls that went out with MSG_ZEROCOPY, each takes the next completion id of the socket.
+        // Their buffers are held until OnZeroCopyDone
+        uint32_t ZeroCopySends() const;
+        void OnZeroCopyDone();
 
     private:
         void reOffset(size_t n);
+        void OnSent(BufferSock::Ptr &buffer);
         ssize_t SendL(int fd, int flags);
+        void BuildMessages(bool udp_gso);
+        ssize_t SendUdp(int fd, int flags);
+        size_t PopDatagrams(size_t msg, bool success);
 
     private:
+        bool udp_ = false;
+        bool gso_failed_ = false;
+        bool zerocopy_ = false;
+        uint32_t zerocopy_sends_ = 0;
         size_t iovec_off_ = 0;
         size_t remain_size_ = 0;
-        std::vector<iovec> iovec_;
+        std::vector<iovec, BufferAllocator<iovec>> iovec_;
         List<BufferSock::Ptr> pkt_list_;
+        // sent, but the kernel may still read their pages
+        List<BufferSock::Ptr> zerocopy_held_;
+
+        // udp: one mmsghdr per datagram or gso run, msg_off_ is the next one to send
+        size_t msg_off_ = 0;
+        std::vector<mmsghdr, BufferAllocator<mmsghdr>> msgs_;
+        std::vector<size_t> msg_counts_;
+        std::vector<char> control_;
     };
     class BufferLikeString : public Buffer
     {
@@ -371,9 +659,10 @@ namespace cyber
             return str_.capacity();
         }
 
+        // room for size bytes of content
         void Reserve(size_t size)
         {
-            str_.reserve();
+            str_.reserve(erase_head_ + size + erase_tail_);
         }
 
         bool Empty() const
@@ -383,18 +672,11 @@ namespace cyber
 
         std::string substr(size_t pos, size_t n = std::string::npos) const
         {
-            if (n == std::string::npos)
-            {
-                if (pos >= Size())
-                {
-                    throw std::out_of_range("BufferLikeString::substr out of range");
-                }
-            }
-            if (pos + erase_head_ > Size())
+            if (pos > Size())
             {
                 throw std::out_of_range("BufferLikeString::substr out of range");
             }
-            return str_.substr(pos + erase_head_, n);
+            return str_.substr(pos + erase_head_, std::min(n, Size() - pos));
         }
 
     private:
@@ -26,6 +26,41 @@ namespace cyber
             });
     }
 
+    ssize_t UDPSession::Send(Buffer::Ptr buf)
+    {
+        auto sock = GetSocket();
+        if (!sock || !peer_addr_len_)
+        {
+            return -1;
+        }
+        return sock->Send(std::move(buf), (sockaddr *)&peer_addr_, peer_addr_len_);
+    }
+
+    ssize_t UDPSession::SendV(std::vector<Buffer::Ptr> bufs)
+    {
+        return SockSender::SendV(std::move(bufs));
+    }
+
+    void UDPSession::Shutdown(const SockException &ex)
+    {
+        auto on_shutdown = std::move(on_shutdown_);
+        on_shutdown_ = nullptr;
+        if (on_shutdown)
+        {
+            on_shutdown(ex);
+        }
+    }
+
+    const sockaddr *UDPSession::GetPeerAddr() const
+    {
+        return (const sockaddr *)&peer_addr_;
+    }
+
+    socklen_t UDPSession::GetPeerAddrLen() const
+    {
+        return peer_addr_len_;
+    }
+
 } // namespace cyberweb
 
 #endif // CYBER_SESSION_CPP
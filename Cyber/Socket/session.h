@@ -2,6 +2,7 @@
 #define CYBER_SESSION_H
 
 #include <memory>
+#include <functional>
 
 #include "sock.h"
 
@@ -38,6 +39,30 @@ namespace cyber
         }
     };
 
+    // one peer of a UDPServer. It shares the server's socket: Send answers the peer and
+    // Shutdown only drops the session, the socket stays open for the other peers.
+    class UDPSession : public Session
+    {
+    public:
+        UDPSession(const Socket::Ptr &sock) : Session(sock){};
+        ~UDPSession() override = default;
+
+        using SockSender::Send;
+        ssize_t Send(Buffer::Ptr buf) override;
+        // every buffer is a datagram to the peer
+        ssize_t SendV(std::vector<Buffer::Ptr> bufs) override;
+        void Shutdown(const SockException &ex = SockException(ERR_SHUTDOWN, "self shutdown")) override;
+
+        const sockaddr *GetPeerAddr() const;
+        socklen_t GetPeerAddrLen() const;
+
+    private:
+        friend class UDPServer;
+        sockaddr_storage peer_addr_;
+        socklen_t peer_addr_len_ = 0;
+        std::function<void(const SockException &ex)> on_shutdown_;
+    };
+
 } // namespace cyberweb
 
 #endif // CYBER_SESSION_H
@@ -3,9 +3,13 @@
 #include <mutex>
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <linux/errqueue.h>
 
 #include "sock.h"
 #include "sockutil.h"
+#include "../Thread/work_thread_pool.h"
 #include "../Util/uv_errno.h"
 
 namespace cyber
@@ -45,27 +49,117 @@ namespace cyber
         return ToSockException(error);
     }
 
+    // a datagram inside a UdpRecvBatch slot, valid only during on_read_ like the shared tcp read buffer
+    class UdpDatagram : public Buffer
+    {
+    public:
+        void Set(char *data, size_t size)
+        {
+            data_ = data;
+            size_ = size;
+        }
+        char *Data() const override
+        {
+            return data_;
+        }
+        size_t Size() const override
+        {
+            return size_;
+        }
+
+    private:
+        char *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // recvmmsg slots of one udp socket, allocated on its first read
+    class UdpRecvBatch
+    {
+    public:
+        UdpRecvBatch() : data_(new char[UDP_RECV_BATCH * (UDP_RECV_SIZE + 1)]), datagram_(std::make_shared<UdpDatagram>())
+        {
+            memset(msgs_, 0, sizeof(msgs_));
+            for (int i = 0; i < UDP_RECV_BATCH; ++i)
+            {
+                // one spare byte per slot for the '\0' the read callback may rely on
+                iovs_[i].iov_base = data_.get() + i * (UDP_RECV_SIZE + 1);
+                iovs_[i].iov_len = UDP_RECV_SIZE;
+                msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+                msgs_[i].msg_hdr.msg_iovlen = 1;
+            }
+        }
+
+        // recvmmsg overwrites the lengths and flags it reports
+        void Reset()
+        {
+            for (int i = 0; i < UDP_RECV_BATCH; ++i)
+            {
+                auto &hdr = msgs_[i].msg_hdr;
+                hdr.msg_name = &addrs_[i];
+                hdr.msg_namelen = sizeof(addrs_[i]);
+                hdr.msg_control = controls_[i];
+                hdr.msg_controllen = sizeof(controls_[i]);
+                hdr.msg_flags = 0;
+            }
+        }
+
+        // gro segment size of slot i, 0 when the kernel delivered a single datagram
+        int Segment(int i)
+        {
+            auto &hdr = msgs_[i].msg_hdr;
+            for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+                {
+                    int segment;
+                    memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+                    return segment;
+                }
+            }
+            return 0;
+        }
+
+    public:
+        std::unique_ptr<char[]> data_;
+        std::shared_ptr<UdpDatagram> datagram_;
+        iovec iovs_[UDP_RECV_BATCH];
+        mmsghdr msgs_[UDP_RECV_BATCH];
+        sockaddr_storage addrs_[UDP_RECV_BATCH];
+        char controls_[UDP_RECV_BATCH][CMSG_SPACE(sizeof(int))];
+    };
+
     Socket::Ptr Socket::CreateSocket(const EventPoller::Ptr &poller, bool enable_recursive_mutex)
     {
         return Socket::Ptr(new Socket(poller, enable_recursive_mutex));
     }
     Socket::Socket(const EventPoller::Ptr &poller, bool enable_recursive_mutex)
+        : sock_fd_lock_(enable_recursive_mutex), event_lock_(enable_recursive_mutex), send_buf_waiting_lock_(enable_recursive_mutex),
+          send_buf_sending_lock_(enable_recursive_mutex), send_buf_zerocopy_lock_(enable_recursive_mutex)
     {
         poller_ = poller;
+        if (poller_)
+        {
+            poller_->socket_count_.fetch_add(1, std::memory_order_relaxed);
+        }
         SetOnRead(nullptr);
         SetOnError(nullptr);
         SetOnAccept(nullptr);
         SetOnFlush(nullptr);
+        SetOnWatermark(nullptr);
         SetOnBeforeAccept(nullptr);
     }
     Socket::~Socket()
     {
         CLoseSock();
+        if (poller_)
+        {
+            poller_->socket_count_.fetch_sub(1, std::memory_order_relaxed);
+        }
     }
 
     void Socket::SetOnRead(OnReadCB cb)
     {
-        std::lock_guard<std::recursive_mutex> guard(event_lock_);
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
         if (cb)
         {
             on_read_ = std::move(cb);
@@ -80,7 +174,7 @@ namespace cyber
     }
     void Socket::SetOnError(OnErrorCB cb)
     {
-        std::lock_guard<std::recursive_mutex> guard(event_lock_);
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
         if (cb)
         {
             on_err_ = std::move(cb);
@@ -95,7 +189,7 @@ namespace cyber
     }
     void Socket::SetOnAccept(OnAcceptCB cb)
     {
-        std::lock_guard<std::recursive_mutex> guard(event_lock_);
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
         if (cb)
         {
             on_accept_ = std::move(cb);
@@ -110,7 +204,7 @@ namespace cyber
     }
     void Socket::SetOnFlush(OnFlushCB cb)
     {
-        std::lock_guard<std::recursive_mutex> guard(event_lock_);
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
         if (cb)
         {
             on_flush_ = std::move(cb);
@@ -121,16 +215,29 @@ namespace cyber
             { return true; };
         }
     }
-    void Socket::SetOnBeforeAccept(OnCreateSocketCB cb)
+    void Socket::SetOnWatermark(OnWatermarkCB cb)
+    {
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
+        if (cb)
+        {
+            on_watermark_ = std::move(cb);
+        }
+        else
+        {
+            on_watermark_ = [](bool high) {};
+        }
+    }
+
+    void Socket::SetOnBeforeAccept(OnBeforeAcceptCB cb)
     {
-        std::lock_guard<std::recursive_mutex> guard(event_lock_);
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
         if (cb)
         {
             on_before_accept_ = std::move(cb);
         }
         else
         {
-            on_before_accept_ = [](const EventPoller::Ptr &poller)
+            on_before_accept_ = [](const EventPoller::Ptr &poller, const sockaddr *addr, int addr_len)
             { return nullptr; };
         }
     }
@@ -166,7 +273,18 @@ namespace cyber
                 }
                 if (event & EVENT_ERROR)
                 {
-                    strong_self->EmitError(GetSockErr(strong_sock));
+                    if (!strong_self->zerocopy_)
+                    {
+                        strong_self->EmitError(GetSockErr(strong_sock));
+                        return;
+                    }
+                    // zero-copy completions raise EPOLLERR as well, only a pending SO_ERROR is fatal
+                    strong_self->OnZeroCopyNotify(strong_sock);
+                    auto err = GetSockErr(strong_sock, false);
+                    if (!err)
+                    {
+                        strong_self->EmitError(err);
+                    }
                 }
             });
 
@@ -174,21 +292,49 @@ namespace cyber
     }
     ssize_t Socket::OnRead(const SockFD::Ptr &sock) noexcept
     {
+        if (sock->GetType() == SockNum::SOCK_TYPE_UDP)
+        {
+            return OnReadUdp(sock);
+        }
         ssize_t ret = 0, nread = 0;
         auto sock_fd = sock->GetFd();
 
-        auto data = read_buffer_->Data();
         auto capacity = read_buffer_->GetCapacity() - 1;
+        BufferRaw::Ptr buffer = owned_read_ ? nullptr : read_buffer_;
 
-        sockaddr addr;
-        socklen_t addr_len = sizeof(sockaddr);
-
-        while (enable_recv_)
+        for (size_t count = 0; enable_recv_; ++count)
         {
+            if ((read_budget_reads_ && count >= read_budget_reads_) || (read_budget_bytes_ && (size_t)ret >= read_budget_bytes_))
+            {
+                // budget spent: let the other fds of the loop run and come back, the edge triggered
+                // socket will not report the data still queued
+                std::weak_ptr<Socket> weak_self = shared_from_this();
+                std::weak_ptr<SockFD> weak_sock = sock;
+                poller_->Async(
+                    [weak_self, weak_sock]()
+                    {
+                        auto strong_self = weak_self.lock();
+                        auto strong_sock = weak_sock.lock();
+                        if (strong_self && strong_sock)
+                        {
+                            strong_self->OnRead(strong_sock);
+                        }
+                    },
+                    false);
+                return ret;
+            }
+
+            auto size = std::min(read_size_, capacity);
+            // a pooled buffer the callback did not keep takes the next read too
+            if (owned_read_ && (!buffer || buffer.use_count() > 1 || buffer->GetCapacity() <= size || buffer->GetCapacity() > 2 * size + 1))
+            {
+                buffer = poller_->GetReadBuffer(size);
+            }
+            auto data = buffer->Data();
             do
             {
-                // nread = recv(sock_fd, data, capacity, 0);
-                nread = recvfrom(sock_fd, data, capacity, 0, &addr, &addr_len);
+                // connected, the peer address is not needed
+                nread = recv(sock_fd, data, size, 0);
             } while (-1 == nread && UV_EINTR == get_uv_error(true));
 
             if (nread == 0)
@@ -207,27 +353,118 @@ namespace cyber
                 return ret;
             }
 
+            // follow the sizes the peer sends: grow when a read fills the size, shrink after a run of small ones
+            if ((size_t)nread == size)
+            {
+                read_size_ = std::min(read_size_ * 2, capacity);
+                read_small_ = 0;
+            }
+            else if ((size_t)nread < read_size_ / 4 && ++read_small_ >= READ_SHRINK_RUN)
+            {
+                read_size_ = std::max(read_size_ / 2, (size_t)READ_MIN_SIZE);
+                read_small_ = 0;
+            }
+
             ret += nread;
             data[nread] = '\0';
-            read_buffer_->SetSize(nread);
+            buffer->SetSize(nread);
 
             try
             {
-                std::lock_guard<std::recursive_mutex> guard(event_lock_);
-                on_read_(read_buffer_, &addr, sizeof(addr));
+                std::lock_guard<decltype(event_lock_)> guard(event_lock_);
+                on_read_(buffer, nullptr, 0);
             }
             catch (std::exception &ex)
             {
                 ErrorL << "on read error: " << ex.what();
             }
         }
-        return 0;
+        return ret;
+    }
+
+    ssize_t Socket::OnReadUdp(const SockFD::Ptr &sock) noexcept
+    {
+        if (!udp_recv_)
+        {
+            udp_recv_.reset(new UdpRecvBatch());
+        }
+        auto &batch = *udp_recv_;
+        auto &datagram = batch.datagram_;
+        Buffer::Ptr buffer = datagram;
+        ssize_t ret = 0;
+        int sock_fd = sock->GetFd();
+
+        while (enable_recv_)
+        {
+            int count;
+            batch.Reset();
+            do
+            {
+                count = recvmmsg(sock_fd, batch.msgs_, UDP_RECV_BATCH, 0, nullptr);
+            } while (-1 == count && UV_EINTR == get_uv_error(true));
+
+            if (count == -1)
+            {
+                // icmp errors of earlier sends surface here, they never end a udp socket
+                auto err = get_uv_error(true);
+                if (err != UV_EAGAIN)
+                {
+                    TraceL << "udp recv failed: " << uv_strerror(err);
+                }
+                return ret;
+            }
+
+            std::lock_guard<decltype(event_lock_)> guard(event_lock_);
+            for (int i = 0; i < count; ++i)
+            {
+                auto &hdr = batch.msgs_[i].msg_hdr;
+                size_t len = batch.msgs_[i].msg_len;
+                if (hdr.msg_flags & MSG_TRUNC)
+                {
+                    WarnL << "udp datagram larger than " << UDP_RECV_SIZE << " bytes dropped";
+                    continue;
+                }
+                ret += len;
+                auto data = (char *)batch.iovs_[i].iov_base;
+                size_t segment = batch.Segment(i);
+                if (!segment)
+                {
+                    segment = len ? len : 1;
+                }
+                // empty datagrams are delivered too, they are valid udp
+                size_t offset = 0;
+                do
+                {
+                    size_t size = std::min(segment, len - offset);
+                    char *end = data + offset + size;
+                    char saved = *end;
+                    *end = '\0';
+                    datagram->Set(data + offset, size);
+                    try
+                    {
+                        on_read_(buffer, (sockaddr *)hdr.msg_name, hdr.msg_namelen);
+                    }
+                    catch (std::exception &ex)
+                    {
+                        ErrorL << "on read error: " << ex.what();
+                    }
+                    *end = saved;
+                    offset += size;
+                } while (offset < len);
+            }
+            // with edge triggering every new datagram raises another event, a short batch means the queue is empty
+            if (count < UDP_RECV_BATCH)
+            {
+                return ret;
+            }
+        }
+        return ret;
     }
 
     bool Socket::EmitError(const SockException &err) noexcept
     {
         {
-            std::lock_guard<std::recursive_mutex> guard(sock_fd_lock_);
+            std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
             if (!sock_fd_)
             {
                 return false;
@@ -243,7 +480,7 @@ namespace cyber
                 {
                     return;
                 }
-                std::lock_guard<std::recursive_mutex> gurad(strong_self->event_lock_);
+                std::lock_guard<decltype(strong_self->event_lock_)> gurad(strong_self->event_lock_);
                 try
                 {
                     strong_self->on_err_(err);
@@ -272,20 +509,18 @@ namespace cyber
         return Send(std::move(buffer), addr, addr_len, try_flush);
     }
 
-    ssize_t Socket::Send(const std::string &buf, sockaddr *addr, socklen_t addr_len, bool try_flush)
+    ssize_t Socket::Send(std::string buf, sockaddr *addr, socklen_t addr_len, bool try_flush)
     {
         if (!buf.size())
         {
             return 0;
         }
-        auto buffer = BufferRaw::Create();
-        buffer->Assign(buf.c_str(), buf.size());
-        return Send(std::move(buffer), addr, addr_len, try_flush);
+        return Send(std::make_shared<BufferString>(std::move(buf)), addr, addr_len, try_flush);
     }
 
     ssize_t Socket::Send(const Buffer::Ptr &buf, sockaddr *addr, socklen_t addr_len, bool try_flush)
     {
-        return Send(std::make_shared<BufferSock>(std::move(buf), addr, addr_len), try_flush);
+        return Send(BufferSock::Create(Detach(buf), addr, addr_len), try_flush);
     }
 
     ssize_t Socket::Send(const BufferSock::Ptr &buf, bool try_flush)
@@ -297,33 +532,247 @@ namespace cyber
         }
         SockFD::Ptr sock;
         {
-            std::lock_guard<std::recursive_mutex> guard(sock_fd_lock_);
+            std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
             sock = sock_fd_;
         }
         if (!sock)
         {
             return -1;
         }
+        // without locks only the poller thread may send
+        assert(send_buf_waiting_lock_.Enabled() || poller_->IsCurrentThread());
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_waiting_lock_);
+            std::lock_guard<decltype(send_buf_waiting_lock_)> guard(send_buf_waiting_lock_);
             send_buf_waiting_.emplace_back(std::move(buf));
         }
+        OnQueued(size);
+        return TryFlush(sock, size, try_flush);
+    }
+
+    ssize_t Socket::SendV(std::vector<Buffer::Ptr> bufs, bool try_flush)
+    {
+        SockFD::Ptr sock;
+        {
+            std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
+            sock = sock_fd_;
+        }
+        if (!sock)
+        {
+            return -1;
+        }
+        assert(send_buf_waiting_lock_.Enabled() || poller_->IsCurrentThread());
+        ssize_t size = 0;
+        {
+            // one lock keeps other senders from interleaving
+            std::lock_guard<decltype(send_buf_waiting_lock_)> guard(send_buf_waiting_lock_);
+            for (auto &buf : bufs)
+            {
+                if (buf && buf->Size())
+                {
+                    size += buf->Size();
+                    send_buf_waiting_.emplace_back(BufferSock::Create(Detach(buf)));
+                }
+            }
+        }
+        if (!size)
+        {
+            return 0;
+        }
+        OnQueued(size);
+        return TryFlush(sock, size, try_flush);
+    }
+
+    ssize_t Socket::Send(const BufferChain &chain, bool try_flush)
+    {
+        return SendV(chain.ToBuffers(), try_flush);
+    }
+
+    Buffer::Ptr Socket::Detach(const Buffer::Ptr &buf)
+    {
+        if (udp_recv_ && buf == udp_recv_->datagram_ && buf->Size() && poller_->IsCurrentThread())
+        {
+            // a received datagram lives in a recv slot the next batch overwrites
+            auto copy = BufferRaw::Create();
+            copy->Assign(buf->Data(), buf->Size());
+            return std::move(copy);
+        }
+        return buf;
+    }
+
+    ssize_t Socket::TryFlush(const SockFD::Ptr &sock, ssize_t size, bool try_flush)
+    {
         if (try_flush)
         {
             if (sendable_)
             {
+                if (sock->GetType() == SockNum::SOCK_TYPE_UDP && poller_->IsCurrentThread())
+                {
+                    // replies sent while the loop dispatches a batch leave in one sendmmsg
+                    FlushLater(sock);
+                    return size;
+                }
                 return FlushData(sock, false) ? size : -1;
             }
-            //TODO timeout
+            if (max_send_buffer_ms_ && sock->GetType() == SockNum::SOCK_TYPE_TCP && ElapsedTimeAfterFlushed() > max_send_buffer_ms_)
+            {
+                EmitError(SockException(ERR_TIMEOUT, "socket send timeout"));
+                return -1;
+            }
         }
         return size;
     }
 
+    void Socket::OnQueued(size_t bytes)
+    {
+        if (send_buf_bytes_.fetch_add(bytes) == 0)
+        {
+            // the age counts from when the queue stopped being empty
+            send_flush_ms_ = GetCurrentMillisecond();
+        }
+        if (send_high_bytes_ && send_buf_bytes_ >= send_high_bytes_ && !congested_)
+        {
+            OnWatermark(true);
+        }
+    }
+
+    void Socket::OnSendProgress(size_t bytes)
+    {
+        if (!bytes)
+        {
+            return;
+        }
+        send_flush_ms_ = GetCurrentMillisecond();
+        auto left = send_buf_bytes_.fetch_sub(bytes) - bytes;
+        if (congested_ && left <= send_low_bytes_)
+        {
+            OnWatermark(false);
+        }
+    }
+
+    void Socket::OnWatermark(bool high)
+    {
+        SockFD::Ptr sock;
+        {
+            std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
+            sock = sock_fd_;
+        }
+        // a shared udp socket serves every peer, one slow peer must not stop it reading
+        if (!sock || sock->GetType() != SockNum::SOCK_TYPE_TCP || congested_.exchange(high) == high)
+        {
+            return;
+        }
+        if (high && enable_recv_)
+        {
+            // the peer is not taking what it already got, stop producing more for it
+            recv_paused_ = true;
+            EnableRecv(false);
+        }
+        else if (!high && recv_paused_.exchange(false))
+        {
+            EnableRecv(true);
+        }
+        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
+        on_watermark_(high);
+    }
+
+    void Socket::StartSendTimer(const SockFD::Ptr &sock)
+    {
+        if (sock->GetType() != SockNum::SOCK_TYPE_TCP || (!max_send_buffer_ms_ && !send_high_ms_))
+        {
+            return;
+        }
+        std::weak_ptr<Socket> weak_self = shared_from_this();
+        if (!poller_->IsCurrentThread())
+        {
+            std::weak_ptr<SockFD> weak_sock = sock;
+            poller_->Async(
+                [weak_self, weak_sock]()
+                {
+                    auto strong_self = weak_self.lock();
+                    auto strong_sock = weak_sock.lock();
+                    if (strong_self && strong_sock)
+                    {
+                        strong_self->StartSendTimer(strong_sock);
+                    }
+                },
+                false);
+            return;
+        }
+        if (send_timer_)
+        {
+            return;
+        }
+        uint64_t delay = max_send_buffer_ms_ && send_high_ms_ ? std::min(max_send_buffer_ms_, send_high_ms_) : std::max(max_send_buffer_ms_, send_high_ms_);
+        send_timer_ = poller_->DoDelayTask(
+            delay, [weak_self]() -> uint64_t
+            {
+                auto strong_self = weak_self.lock();
+                return strong_self ? strong_self->OnSendTimer() : 0;
+            });
+    }
+
+    uint64_t Socket::OnSendTimer()
+    {
+        if (sendable_ || GetFD() == -1)
+        {
+            send_timer_ = nullptr;
+            return 0;
+        }
+        auto age = ElapsedTimeAfterFlushed();
+        if (max_send_buffer_ms_ && age >= max_send_buffer_ms_)
+        {
+            send_timer_ = nullptr;
+            EmitError(SockException(ERR_TIMEOUT, "socket send timeout"));
+            return 0;
+        }
+        if (send_high_ms_ && age >= send_high_ms_ && !congested_)
+        {
+            OnWatermark(true);
+        }
+        // wake when the next threshold would pass without progress
+        uint64_t next = 0;
+        if (max_send_buffer_ms_)
+        {
+            next = max_send_buffer_ms_ - age;
+        }
+        if (send_high_ms_ && age < send_high_ms_ && (!next || send_high_ms_ - age < next))
+        {
+            next = send_high_ms_ - age;
+        }
+        return next ? next : send_high_ms_;
+    }
+
+    void Socket::FlushLater(const SockFD::Ptr &sock)
+    {
+        if (flush_pending_.exchange(true))
+        {
+            return;
+        }
+        std::weak_ptr<Socket> weak_self = shared_from_this();
+        std::weak_ptr<SockFD> weak_sock = sock;
+        poller_->Async(
+            [weak_self, weak_sock]()
+            {
+                auto strong_self = weak_self.lock();
+                auto strong_sock = weak_sock.lock();
+                if (!strong_self)
+                {
+                    return;
+                }
+                strong_self->flush_pending_ = false;
+                if (strong_sock && strong_self->sendable_)
+                {
+                    strong_self->FlushData(strong_sock, false);
+                }
+            },
+            false);
+    }
+
     void Socket::OnFlushed(const SockFD::Ptr &p_sock)
     {
         bool flag;
         {
-            std::lock_guard<std::recursive_mutex> guard(event_lock_);
+            std::lock_guard<decltype(event_lock_)> guard(event_lock_);
             flag = on_flush_();
         }
         if (!flag)
@@ -335,7 +784,28 @@ namespace cyber
     void Socket::CLoseSock()
     {
         async_con_cb_ = nullptr;
-        std::lock_guard<std::recursive_mutex> guard(sock_fd_lock_);
+        if (con_timer_)
+        {
+            con_timer_->Cancel();
+            con_timer_ = nullptr;
+        }
+        if (send_timer_)
+        {
+            send_timer_->Cancel();
+            send_timer_ = nullptr;
+        }
+        if (zerocopy_.exchange(false))
+        {
+            // completion ids start over on the next fd
+            zerocopy_min_size_ = 0;
+            zerocopy_copied_ = false;
+            std::lock_guard<decltype(send_buf_zerocopy_lock_)> guard(send_buf_zerocopy_lock_);
+            zerocopy_next_ = 0;
+            zerocopy_done_ = 0;
+            zerocopy_ranges_.clear();
+            send_buf_zerocopy_.clear();
+        }
+        std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
         sock_fd_ = nullptr;
         // epoll fd delete in deconstroctor of sock_fd;
     }
@@ -344,11 +814,11 @@ namespace cyber
     {
         int ret = 0;
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_waiting_lock_);
+            std::lock_guard<decltype(send_buf_waiting_lock_)> guard(send_buf_waiting_lock_);
             ret += send_buf_waiting_.size();
         }
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_sending_lock_);
+            std::lock_guard<decltype(send_buf_sending_lock_)> guard(send_buf_sending_lock_);
             send_buf_sending_.ForEach(
                 [&](BufferList::Ptr &buf)
                 {
@@ -358,9 +828,20 @@ namespace cyber
         return ret;
     }
 
+    size_t Socket::GetSendBufferBytes() const
+    {
+        return send_buf_bytes_;
+    }
+
     uint64_t Socket::ElapsedTimeAfterFlushed()
     {
-        return 0;
+        if (!send_buf_bytes_)
+        {
+            return 0;
+        }
+        auto now = GetCurrentMillisecond();
+        uint64_t since = send_flush_ms_;
+        return now > since ? now - since : 0;
     }
 
     bool Socket::Listen(const SockFD::Ptr &sock)
@@ -370,7 +851,7 @@ namespace cyber
         std::weak_ptr<Socket> weak_self = shared_from_this();
         enable_recv_ = true;
         int result = poller_->AddEvent(
-            sock->GetFd(), EVENT_READ | EVENT_ERROR, [weak_sock, weak_self](int event)
+            sock->GetFd(), EVENT_READ | EVENT_ERROR | EVENT_EXCLUSIVE, [weak_sock, weak_self](int event)
             {
                 auto strong_sock = weak_sock.lock();
                 auto strong_self = weak_self.lock();
@@ -385,14 +866,14 @@ namespace cyber
         {
             return false;
         }
-        std::lock_guard<std::recursive_mutex> guard(sock_fd_lock_);
+        std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
         sock_fd_ = sock;
         return true;
     }
 
-    bool Socket::Listen(uint16_t port, const std::string &local_ip, int backlog)
+    bool Socket::Listen(uint16_t port, const std::string &local_ip, int backlog, const SockOptions &options)
     {
-        int sock = SockUtil::Listen(port, local_ip.c_str(), backlog);
+        int sock = SockUtil::Listen(port, local_ip.c_str(), backlog, options);
         if (-1 == sock)
         {
             return false;
@@ -400,16 +881,295 @@ namespace cyber
         return Listen(MakeSock(sock));
     }
 
+    void Socket::Connect(const std::string &host, uint16_t port, const OnErrorCB &con_cb, float timeout_sec)
+    {
+        std::weak_ptr<Socket> weak_self = shared_from_this();
+        poller_->Async(
+            [weak_self, host, port, con_cb, timeout_sec]()
+            {
+                auto strong_self = weak_self.lock();
+                if (strong_self)
+                {
+                    strong_self->ConnectL(host, port, con_cb, timeout_sec);
+                }
+            });
+    }
+
+    void Socket::ConnectL(const std::string &host, uint16_t port, const OnErrorCB &con_cb, float timeout_sec)
+    {
+        CLoseSock();
+        std::weak_ptr<Socket> weak_self = shared_from_this();
+        // connected, failed or timed out: whichever comes first is reported, on the poller
+        auto done = std::make_shared<bool>(false);
+        OnErrorCB con_cb_once = [weak_self, con_cb, done](const SockException &err)
+        {
+            auto strong_self = weak_self.lock();
+            if (*done || !strong_self)
+            {
+                return;
+            }
+            *done = true;
+            strong_self->async_con_cb_ = nullptr;
+            if (strong_self->con_timer_)
+            {
+                strong_self->con_timer_->Cancel();
+                strong_self->con_timer_ = nullptr;
+            }
+            if (!err)
+            {
+                strong_self->CLoseSock();
+            }
+            con_cb(err);
+        };
+
+        auto async_con_cb = std::make_shared<std::function<void(int)>>(
+            [weak_self, con_cb_once](int fd)
+            {
+                auto strong_self = weak_self.lock();
+                if (!strong_self)
+                {
+                    CLOSE_SOCK(fd);
+                    return;
+                }
+                if (fd == -1)
+                {
+                    con_cb_once(SockException(ERR_OTHER, get_uv_errmsg(true)));
+                    return;
+                }
+                auto sock = strong_self->MakeSock(fd);
+                std::weak_ptr<SockFD> weak_sock = sock;
+                int result = strong_self->poller_->AddEvent(
+                    fd, EVENT_WRITE | EVENT_ERROR, [weak_self, weak_sock, con_cb_once](int event)
+                    {
+                        auto strong_self = weak_self.lock();
+                        auto strong_sock = weak_sock.lock();
+                        if (strong_self && strong_sock)
+                        {
+                            strong_self->OnConnected(strong_sock, con_cb_once);
+                        }
+                    });
+                if (result == -1)
+                {
+                    con_cb_once(SockException(ERR_OTHER, "add event to poller failed when start connect"));
+                    return;
+                }
+                std::lock_guard<decltype(strong_self->sock_fd_lock_)> guard(strong_self->sock_fd_lock_);
+                strong_self->sock_fd_ = sock;
+            });
+        async_con_cb_ = async_con_cb;
+
+        con_timer_ = poller_->DoDelayTask(
+            (uint64_t)(timeout_sec * 1000), [con_cb_once]()
+            {
+                con_cb_once(SockException(ERR_TIMEOUT, uv_strerror(UV_ETIMEDOUT)));
+                return 0;
+            });
+
+        auto connect = [port](const std::string &ip)
+        {
+            try
+            {
+                return SockUtil::Connect(ip.data(), AF_INET, port, true);
+            }
+            catch (...)
+            {
+                return -1;
+            }
+        };
+        if (SockUtil::IsIP(host.data()))
+        {
+            (*async_con_cb)(connect(host));
+            return;
+        }
+
+        // getaddrinfo blocks, keep it off the loop
+        std::weak_ptr<std::function<void(int)>> weak_task = async_con_cb;
+        WorkThreadPool::Instance().AsyncThen(
+            [host]()
+            {
+                std::string ip;
+                SockUtil::ResolveHost(host.data(), ip);
+                return ip;
+            },
+            [weak_task, con_cb_once, connect, host](std::string ip)
+            {
+                auto task = weak_task.lock();
+                if (!task)
+                {
+                    return;
+                }
+                if (ip.empty())
+                {
+                    con_cb_once(SockException(ERR_DNS, "dns resolve failed: " + host));
+                    return;
+                }
+                (*task)(connect(ip));
+            },
+            poller_);
+    }
+
+    void Socket::OnConnected(const SockFD::Ptr &sock, const OnErrorCB &cb)
+    {
+        auto err = GetSockErr(sock, false);
+        if (!err)
+        {
+            cb(err);
+            return;
+        }
+        // the connect handler makes way for the regular one
+        poller_->DelEvent(sock->GetFd());
+        if (!AttachEvent(sock))
+        {
+            cb(SockException(ERR_OTHER, "add event to poller failed when connected"));
+            return;
+        }
+        cb(err);
+    }
+
+    bool Socket::BindUdpSock(uint16_t port, const std::string &local_ip, bool enable_reuse)
+    {
+        CLoseSock();
+        int fd = SockUtil::BindUdpSock(port, local_ip.c_str(), enable_reuse);
+        if (-1 == fd)
+        {
+            return false;
+        }
+        auto sock = MakeSock(fd, SockNum::SOCK_TYPE_UDP);
+        if (!AttachEvent(sock))
+        {
+            return false;
+        }
+        std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
+        sock_fd_ = sock;
+        return true;
+    }
+
+    bool Socket::EnableUdpGso(bool enable)
+    {
+        int fd = GetFD();
+        if (enable && (fd == -1 || !SockUtil::SupportUdpGso(fd)))
+        {
+            return false;
+        }
+        udp_gso_ = enable;
+        return true;
+    }
+
+    bool Socket::EnableUdpGro(bool enable)
+    {
+        int fd = GetFD();
+        return fd != -1 && SockUtil::setUdpGro(fd, enable) != -1;
+    }
+
+    bool Socket::EnableZeroCopy(size_t min_size)
+    {
+        SockFD::Ptr sock;
+        {
+            std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
+            sock = sock_fd_;
+        }
+        if (!sock || sock->GetType() != SockNum::SOCK_TYPE_TCP)
+        {
+            return false;
+        }
+        if (min_size && zerocopy_copied_)
+        {
+            return false;
+        }
+        if (min_size && !zerocopy_)
+        {
+            if (SockUtil::setZeroCopy(sock->GetFd()) == -1)
+            {
+                return false;
+            }
+            zerocopy_ = true;
+        }
+        zerocopy_min_size_ = min_size;
+        return true;
+    }
+
+    void Socket::OnZeroCopyNotify(const SockFD::Ptr &sock)
+    {
+        bool copied = false;
+        while (true)
+        {
+            char control[128];
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(sock->GetFd(), &msg, MSG_ERRQUEUE) == -1)
+            {
+                break;
+            }
+            for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                    !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+                {
+                    continue;
+                }
+                sock_extended_err err;
+                memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno)
+                {
+                    continue;
+                }
+                copied |= (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+                // ee_info..ee_data, inclusive
+                OnZeroCopyDone(err.ee_info, err.ee_data);
+            }
+        }
+        // the route could not take the pages (loopback, no sg offload), the kernel copied after all
+        if (copied && !zerocopy_copied_.exchange(true))
+        {
+            zerocopy_min_size_ = 0;
+            DebugL << "zero-copy sends were copied by the kernel, disabled on fd " << sock->GetFd();
+        }
+    }
+
+    void Socket::OnZeroCopyDone(uint32_t lo, uint32_t hi)
+    {
+        std::lock_guard<decltype(send_buf_zerocopy_lock_)> guard(send_buf_zerocopy_lock_);
+        if (lo != zerocopy_done_)
+        {
+            // out of order, kept until the gap closes
+            zerocopy_ranges_[lo] = hi;
+            return;
+        }
+        zerocopy_done_ = hi + 1;
+        auto it = zerocopy_ranges_.begin();
+        while (it != zerocopy_ranges_.end() && it->first <= zerocopy_done_)
+        {
+            zerocopy_done_ = std::max(zerocopy_done_, it->second + 1);
+            it = zerocopy_ranges_.erase(it);
+        }
+        ReleaseZeroCopy();
+    }
+
+    void Socket::ReleaseZeroCopy()
+    {
+        while (!send_buf_zerocopy_.empty() && send_buf_zerocopy_.front().first < zerocopy_done_)
+        {
+            send_buf_zerocopy_.front().second->OnZeroCopyDone();
+            send_buf_zerocopy_.pop_front();
+        }
+    }
+
     int Socket::OnAccept(const SockFD::Ptr &sock, int event) noexcept
     {
         int fd;
-        while (true)
+        sockaddr_storage peer_addr;
+        socklen_t addr_len;
+        if (event & EVENT_READ)
         {
-            if (event & EVENT_READ)
+            for (size_t count = 0; !accept_budget_ || count < accept_budget_; ++count)
             {
                 do
                 {
-                    fd = (int)accept(sock->GetFd(), NULL, NULL);
+                    addr_len = sizeof(peer_addr);
+                    // nodelay, buffers and linger come from the listener, only the file flags are per fd
+                    fd = accept4(sock->GetFd(), (sockaddr *)&peer_addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
                 } while (-1 == fd && UV_EINTR == get_uv_error(true));
                 if (fd == -1)
                 {
@@ -424,19 +1184,12 @@ namespace cyber
                     return -1;
                 }
 
-                SockUtil::SetNoBlocked(fd);
-                SockUtil::setNoDelay(fd);
-                SockUtil::setSendBuf(fd);
-                SockUtil::setRecvBuf(fd);
-                SockUtil::setCloseWait(fd);
-                SockUtil::setCloExec(fd);
-
                 Socket::Ptr peer_sock;
                 {
                     try
                     {
-                        std::lock_guard<std::recursive_mutex> guard(event_lock_);
-                        peer_sock = on_before_accept_(poller_);
+                        std::lock_guard<decltype(event_lock_)> guard(event_lock_);
+                        peer_sock = on_before_accept_(poller_, (sockaddr *)&peer_addr, addr_len);
                     }
                     catch (const std::exception &e)
                     {
@@ -471,7 +1224,7 @@ namespace cyber
 
                 try
                 {
-                    std::lock_guard<std::recursive_mutex> guard(event_lock_);
+                    std::lock_guard<decltype(event_lock_)> guard(event_lock_);
                     on_accept_(peer_sock, completed);
                 }
                 catch (const std::exception &e)
@@ -481,30 +1234,49 @@ namespace cyber
                 }
             }
 
-            if (event & EVENT_ERROR)
-            {
-                auto ex = GetSockErr(sock);
-                EmitError(ex);
-                ErrorL << "tcp server listen failed" << ex.what();
-                return -1;
-            }
+            // budget spent: let the rest of the batch run and come back, the edge triggered
+            // listener will not report the connections still queued
+            std::weak_ptr<Socket> weak_self = shared_from_this();
+            std::weak_ptr<SockFD> weak_sock = sock;
+            poller_->Async(
+                [weak_self, weak_sock]()
+                {
+                    auto strong_self = weak_self.lock();
+                    auto strong_sock = weak_sock.lock();
+                    if (strong_self && strong_sock)
+                    {
+                        strong_self->OnAccept(strong_sock, EVENT_READ);
+                    }
+                },
+                false);
+            return 0;
         }
+
+        if (event & EVENT_ERROR)
+        {
+            auto ex = GetSockErr(sock);
+            EmitError(ex);
+            ErrorL << "tcp server listen failed" << ex.what();
+            return -1;
+        }
+        return 0;
     }
 
     SockFD::Ptr Socket::SetPeerSock(int fd)
     {
         CLoseSock();
         auto sock = MakeSock(fd);
-        std::lock_guard<std::recursive_mutex> guard(sock_fd_lock_);
+        std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
         sock_fd_ = sock;
         return sock;
     }
 
     bool Socket::FlushData(const SockFD::Ptr &sock, bool poller_thread)
     {
+        assert(send_buf_sending_lock_.Enabled() || poller_->IsCurrentThread());
         decltype(send_buf_sending_) send_buf_sending_tmp;
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_sending_lock_);
+            std::lock_guard<decltype(send_buf_sending_lock_)> guard(send_buf_sending_lock_);
             if (!send_buf_sending_.empty())
             {
                 send_buf_sending_tmp.swap(send_buf_sending_);
@@ -516,10 +1288,11 @@ namespace cyber
             do
             {
                 {
-                    std::lock_guard<std::recursive_mutex> guard(send_buf_waiting_lock_);
+                    std::lock_guard<decltype(send_buf_waiting_lock_)> guard(send_buf_waiting_lock_);
                     if (!send_buf_waiting_.empty())
                     {
-                        send_buf_sending_tmp.emplace_back(std::make_shared<BufferList>(send_buf_waiting_));
+                        bool udp = sock->GetType() == SockNum::SOCK_TYPE_UDP;
+                        send_buf_sending_tmp.emplace_back(BufferList::Create(send_buf_waiting_, udp, udp && udp_gso_, zerocopy_min_size_));
                         break;
                     }
                 }
@@ -535,11 +1308,31 @@ namespace cyber
         while (!send_buf_sending_tmp.empty())
         {
             auto &subbuffer = send_buf_sending_tmp.front();
+            auto zerocopy_sends = subbuffer->ZeroCopySends();
+            auto remain_size = subbuffer->RemainSize();
             int n = subbuffer->Send(fd, sock_flags_);
-            if (n > 0)
+            OnSendProgress(remain_size - subbuffer->RemainSize());
+            if (subbuffer->GsoFailed() && udp_gso_.exchange(false))
+            {
+                WarnL << "udp gso rejected by the kernel, disabled on fd " << fd;
+            }
+            if (subbuffer->ZeroCopySends() != zerocopy_sends)
+            {
+                std::lock_guard<decltype(send_buf_zerocopy_lock_)> guard(send_buf_zerocopy_lock_);
+                zerocopy_next_ += subbuffer->ZeroCopySends() - zerocopy_sends;
+            }
+            // a udp batch may end empty with nothing sent when every datagram was dropped
+            if (n > 0 || subbuffer->Empty())
             {
                 if (subbuffer->Empty())
                 {
+                    if (subbuffer->ZeroCopySends())
+                    {
+                        // the kernel may still read the pages, hold the list until its last send completes
+                        std::lock_guard<decltype(send_buf_zerocopy_lock_)> guard(send_buf_zerocopy_lock_);
+                        send_buf_zerocopy_.emplace_back(zerocopy_next_ - 1, std::move(subbuffer));
+                        ReleaseZeroCopy();
+                    }
                     send_buf_sending_tmp.pop_front();
                     continue;
                 }
@@ -564,7 +1357,7 @@ namespace cyber
         }
         if (!send_buf_sending_tmp.empty())
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_sending_lock_);
+            std::lock_guard<decltype(send_buf_sending_lock_)> guard(send_buf_sending_lock_);
             send_buf_sending_tmp.swap(send_buf_sending_);
             send_buf_sending_.Append(send_buf_sending_tmp);
             return true;
@@ -576,11 +1369,11 @@ namespace cyber
     {
         bool empty_waiting, empty_sending;
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_waiting_lock_);
+            std::lock_guard<decltype(send_buf_waiting_lock_)> guard(send_buf_waiting_lock_);
             empty_waiting = send_buf_waiting_.empty();
         }
         {
-            std::lock_guard<std::recursive_mutex> guard(send_buf_sending_lock_);
+            std::lock_guard<decltype(send_buf_sending_lock_)> guard(send_buf_sending_lock_);
             empty_sending = send_buf_sending_.empty();
         }
         if (empty_sending && empty_waiting)
@@ -598,6 +1391,7 @@ namespace cyber
         sendable_ = false;
         int recv_flag = enable_recv_ ? EVENT_READ : 0;
         poller_->ModifyEvent(sock->GetFd(), recv_flag | EVENT_WRITE | EVENT_ERROR);
+        StartSendTimer(sock);
     }
 
     void Socket::StopWriteAbleEvent(const SockFD::Ptr &sock)
@@ -619,14 +1413,14 @@ namespace cyber
         poller_->ModifyEvent(GetFD(), recv_flag | send_flag | EVENT_ERROR);
     }
 
-    SockFD::Ptr Socket::MakeSock(int sock)
+    SockFD::Ptr Socket::MakeSock(int sock, SockNum::SockType type)
     {
-        return std::make_shared<SockFD>(sock, poller_);
+        return std::make_shared<SockFD>(sock, poller_, type);
     }
 
     int Socket::GetFD()
     {
-        std::lock_guard<std::recursive_mutex> guard(sock_fd_lock_);
+        std::lock_guard<decltype(sock_fd_lock_)> guard(sock_fd_lock_);
         if (!sock_fd_)
         {
             return -1;
@@ -636,7 +1430,14 @@ namespace cyber
 
     void Socket::SetTimeOutSecond(uint32_t second)
     {
-        max_send_buffer_ms_ = second;
+        max_send_buffer_ms_ = second * 1000;
+    }
+
+    void Socket::SetSendWatermark(size_t high_bytes, size_t low_bytes, uint32_t high_ms)
+    {
+        send_high_bytes_ = high_bytes;
+        send_low_bytes_ = std::min(low_bytes, high_bytes);
+        send_high_ms_ = high_ms;
     }
 
     bool Socket::IsSocketBusy() const
@@ -651,14 +1452,30 @@ namespace cyber
 
     void Socket::SetSendFlags(int flags)
     {
-        sendable_ = flags;
+        sock_flags_ = flags;
+    }
+
+    void Socket::EnableOwnedRead(bool enable)
+    {
+        owned_read_ = enable;
+    }
+
+    void Socket::SetReadBudget(size_t bytes, size_t reads)
+    {
+        read_budget_bytes_ = bytes;
+        read_budget_reads_ = reads;
+    }
+
+    void Socket::SetAcceptBudget(size_t budget)
+    {
+        accept_budget_ = budget;
     }
 
     bool Socket::CloneFromListenSocket(const Socket::Ptr &other)
     {
         SockFD::Ptr sock;
         {
-            std::lock_guard<std::recursive_mutex> guard(other->sock_fd_lock_);
+            std::lock_guard<decltype(other->sock_fd_lock_)> guard(other->sock_fd_lock_);
             if (!other->sock_fd_)
             {
                 WarnL << "sockfd of src socket is null";
@@ -689,9 +1506,7 @@ namespace cyber
 
     ssize_t SockSender::Send(std::string buf)
     {
-        auto buffer = BufferRaw::Create();
-        buffer->Assign(buf.c_str(), buf.size());
-        return Send(std::move(buffer));
+        return Send(std::make_shared<BufferString>(std::move(buf)));
     }
 
     ssize_t SockSender::Send(const char *buf, size_t size)
@@ -701,6 +1516,30 @@ namespace cyber
         return Send(std::move(buffer));
     }
 
+    ssize_t SockSender::Send(const BufferChain &chain)
+    {
+        return SendV(chain.ToBuffers());
+    }
+
+    ssize_t SockSender::SendV(std::vector<Buffer::Ptr> bufs)
+    {
+        ssize_t size = 0;
+        for (auto &buf : bufs)
+        {
+            if (!buf)
+            {
+                continue;
+            }
+            auto n = Send(std::move(buf));
+            if (n < 0)
+            {
+                return n;
+            }
+            size += n;
+        }
+        return size;
+    }
+
     SocketHelper::SocketHelper(const Socket::Ptr &sock)
     {
         SetSocket(sock);
@@ -771,6 +1610,15 @@ namespace cyber
         return sock_->Send(std::move(buf), nullptr, 0, try_flush_);
     }
 
+    ssize_t SocketHelper::SendV(std::vector<Buffer::Ptr> bufs)
+    {
+        if (!sock_)
+        {
+            return -1;
+        }
+        return sock_->SendV(std::move(bufs), try_flush_);
+    }
+
     void SocketHelper::Shutdown(const SockException &ex)
     {
         sock_->EmitError(ex);
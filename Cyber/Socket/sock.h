@@ -7,15 +7,33 @@
 #include <functional>
 #include <atomic>
 #include <mutex>
+#include <map>
 #include <sys/unistd.h>
 
 #include "../Util/util.h"
 #include "../Poller/poller.h"
 #include "buffer.h"
 #include "../Util/logger.h"
+#include "sockutil.h"
 
 #define SOCKET_DEFAULE_FLAGS (MSG_NOSIGNAL | MSG_DONTWAIT)
 #define SEND_TIME_OUT_SEC 10
+// queued bytes at which a tcp socket counts as congested and stops reading, and where it recovers
+#define SEND_HIGH_WATERMARK (4 * 1024 * 1024)
+#define SEND_LOW_WATERMARK (1024 * 1024)
+// connections taken per listener wakeup before the other fds of the loop get their turn
+#define ACCEPT_BUDGET 64
+// bytes and reads a tcp socket takes per readable event before the other fds of the loop get their turn
+#define READ_BUDGET_BYTES (512 * 1024)
+#define READ_BUDGET_COUNT 32
+// a tcp socket's read size follows what its reads return, halved after this many small reads
+#define READ_MIN_SIZE (4 * 1024)
+#define READ_SHRINK_RUN 8
+// datagrams taken per recvmmsg, and the room for each (a gro burst fills up to 64KB)
+#define UDP_RECV_BATCH 16
+#define UDP_RECV_SIZE (64 * 1024)
+// below this pinning the pages and reading the completion costs more than the copy
+#define ZEROCOPY_MIN_SIZE (32 * 1024)
 
 namespace cyber
 {
@@ -78,24 +96,31 @@ namespace cyber
     {
     public:
         typedef std::shared_ptr<SockNum> Ptr;
-        SockNum(int fd) : fd_(fd){};
+        typedef enum
+        {
+            SOCK_TYPE_TCP = 0,
+            SOCK_TYPE_UDP
+        } SockType;
+        SockNum(int fd, SockType type = SOCK_TYPE_TCP) : fd_(fd), type_(type){};
         ~SockNum()
         {
             close(fd_);
         }
         int GetFD() const { return fd_; }
+        SockType GetType() const { return type_; }
 
     private:
         int fd_;
+        SockType type_;
     };
 
     class SockFD : public noncopyable
     {
     public:
         typedef std::shared_ptr<SockFD> Ptr;
-        SockFD(int fd, EventPoller::Ptr poller)
+        SockFD(int fd, EventPoller::Ptr poller, SockNum::SockType type = SockNum::SOCK_TYPE_TCP)
         {
-            fd_ = std::make_shared<SockNum>(fd);
+            fd_ = std::make_shared<SockNum>(fd, type);
             poller_ = poller;
         }
         SockFD(SockFD::Ptr other, EventPoller::Ptr poller)
@@ -107,7 +132,9 @@ namespace cyber
         {
             try
             {
-                poller_->DelEvent(fd_->GetFD());
+                // the fd stays open until the poller has dropped it, so its number can not be reused meanwhile
+                auto fd = fd_;
+                poller_->DelEvent(fd_->GetFD(), [fd](bool success) {});
             }
             catch (const std::exception &e)
             {
@@ -118,12 +145,18 @@ namespace cyber
         {
             return fd_->GetFD();
         }
+        SockNum::SockType GetType() const
+        {
+            return fd_->GetType();
+        }
 
     private:
         SockNum::Ptr fd_;
         EventPoller::Ptr poller_;
     };
 
+    class UdpRecvBatch;
+
     class Socket : public std::enable_shared_from_this<Socket>, public noncopyable
     {
     public:
@@ -133,45 +166,99 @@ namespace cyber
         typedef std::function<void(const SockException &err)> OnErrorCB;
         typedef std::function<void(Socket::Ptr &sock, std::shared_ptr<void> &complete)> OnAcceptCB;
         typedef std::function<bool()> OnFlushCB;
+        typedef std::function<void(bool high)> OnWatermarkCB;
         typedef std::function<Ptr(const EventPoller::Ptr &poller)> OnCreateSocketCB;
+        // addr is the peer of the connection being accepted
+        typedef std::function<Ptr(const EventPoller::Ptr &poller, const sockaddr *addr, int addr_len)> OnBeforeAcceptCB;
 
+        // without enable_recursive_mutex the socket belongs to its poller: it may be set up from any thread
+        // before its events start, afterwards only the poller thread may touch it and no lock is taken
         static Ptr CreateSocket(const EventPoller::Ptr &poller, bool enable_recursive_mutex = true);
         Socket(const EventPoller::Ptr &poller, bool enable_recursive_mutex = true);
 
         ~Socket();
 
-        virtual bool Listen(uint16_t port, const std::string &local_ip, int backlog = 1024);
+        virtual bool Listen(uint16_t port, const std::string &local_ip, int backlog = 1024, const SockOptions &options = SockOptions());
+        // non-blocking connect on the poller, a host name is resolved on the WorkThreadPool first.
+        // con_cb runs once on the poller: success when writable, else the error, ERR_DNS or ERR_TIMEOUT
+        virtual void Connect(const std::string &host, uint16_t port, const OnErrorCB &con_cb, float timeout_sec = 5);
+        // the read callback gets each datagram with its sender, Send with an addr answers it
+        virtual bool BindUdpSock(uint16_t port, const std::string &local_ip = "0.0.0.0", bool enable_reuse = true);
+        // segmentation offload for queued equal sized datagrams, false when the kernel lacks it
+        virtual bool EnableUdpGso(bool enable = true);
+        // receive offload, the read callback still sees one datagram at a time
+        virtual bool EnableUdpGro(bool enable = true);
+        // tcp flushes of min_size bytes or more go out with MSG_ZEROCOPY, their buffers are released
+        // (and OnSendSuccess called) once the kernel reports it is done with the pages. 0 turns it off.
+        // Call once connected, false when the kernel lacks SO_ZEROCOPY or had to copy them anyway
+        virtual bool EnableZeroCopy(size_t min_size = ZEROCOPY_MIN_SIZE);
+        // tcp reads land in buffers of the poller's pools instead of its shared one, so the read
+        // callback may keep what it gets rather than copy it. On the poller's thread
+        virtual void EnableOwnedRead(bool enable = true);
 
         virtual void SetOnRead(OnReadCB cb);
         virtual void SetOnError(OnErrorCB cb);
         virtual void SetOnAccept(OnAcceptCB cb);
         virtual void SetOnFlush(OnFlushCB cb);
-        virtual void SetOnBeforeAccept(OnCreateSocketCB cb);
+        // high when the send queue crosses the high watermark, low once it is drained below the low one
+        virtual void SetOnWatermark(OnWatermarkCB cb);
+        virtual void SetOnBeforeAccept(OnBeforeAcceptCB cb);
 
         ssize_t Send(const char *buf, size_t size = 0, sockaddr *addr = nullptr, socklen_t addr_len = 0, bool try_flush = true);
-        ssize_t Send(const std::string &buf, sockaddr *addr = nullptr, socklen_t addr_len = 0, bool try_flush = true);
+        // the string is moved into the send queue, not copied
+        ssize_t Send(std::string buf, sockaddr *addr = nullptr, socklen_t addr_len = 0, bool try_flush = true);
         ssize_t Send(const Buffer::Ptr &buf, sockaddr *addr = nullptr, socklen_t addr_len = 0, bool try_flush = true);
         virtual ssize_t Send(const BufferSock::Ptr &buf, bool try_flush = true);
+        // queue the buffers back to back and flush once, they leave in one writev when the kernel takes them.
+        // on udp every buffer is a datagram of its own
+        virtual ssize_t SendV(std::vector<Buffer::Ptr> bufs, bool try_flush = true);
+        // tcp: the segments are queued as they are, each an iovec of the writev
+        ssize_t Send(const BufferChain &chain, bool try_flush = true);
 
         virtual bool EmitError(const SockException &err) noexcept;
         virtual void EnableRecv(bool enabled);
         virtual int GetFD();
+        // a tcp socket whose queued data makes no progress for this long fails with ERR_TIMEOUT, 0 never
         virtual void SetTimeOutSecond(uint32_t second);
+        // over high_bytes queued, or no progress for high_ms (0 ignores the age), a tcp socket pauses
+        // reading and reports high; at low_bytes or less it reads again and reports low. high_bytes 0 disables
+        virtual void SetSendWatermark(size_t high_bytes, size_t low_bytes, uint32_t high_ms = 0);
         virtual bool IsSocketBusy() const;
         virtual const EventPoller::Ptr GetPoller() const;
         virtual void SetSendFlags(int flags = SOCKET_DEFAULE_FLAGS);
+        // 0 accepts until the backlog is empty
+        virtual void SetAcceptBudget(size_t budget);
+        // per readable event, 0 reads until the kernel buffer is empty. Tcp only, udp reads in batches
+        virtual void SetReadBudget(size_t bytes, size_t reads);
 
         virtual bool CloneFromListenSocket(const Socket::Ptr &other);
 
         virtual void CLoseSock();
         virtual size_t GetSendBufferCount();
+        // queued bytes not taken by the kernel yet
+        virtual size_t GetSendBufferBytes() const;
+        // ms since the send queue last made progress, 0 while it is empty
         virtual uint64_t ElapsedTimeAfterFlushed();
 
     private:
         SockFD::Ptr SetPeerSock(int fd);
-        SockFD::Ptr MakeSock(int sock);
+        SockFD::Ptr MakeSock(int sock, SockNum::SockType type = SockNum::SOCK_TYPE_TCP);
+        void ConnectL(const std::string &host, uint16_t port, const OnErrorCB &con_cb, float timeout_sec);
+        void OnConnected(const SockFD::Ptr &sock, const OnErrorCB &cb);
         int OnAccept(const SockFD::Ptr &sock, int event) noexcept;
         ssize_t OnRead(const SockFD::Ptr &sock) noexcept;
+        ssize_t OnReadUdp(const SockFD::Ptr &sock) noexcept;
+        Buffer::Ptr Detach(const Buffer::Ptr &buf);
+        ssize_t TryFlush(const SockFD::Ptr &sock, ssize_t size, bool try_flush);
+        void FlushLater(const SockFD::Ptr &sock);
+        void OnZeroCopyNotify(const SockFD::Ptr &sock);
+        void OnZeroCopyDone(uint32_t lo, uint32_t hi);
+        void ReleaseZeroCopy();
+        void OnQueued(size_t bytes);
+        void OnSendProgress(size_t bytes);
+        void OnWatermark(bool high);
+        void StartSendTimer(const SockFD::Ptr &sock);
+        uint64_t OnSendTimer();
         void OnWriteAble(const SockFD::Ptr &sock);
         void OnFlushed(const SockFD::Ptr &p_sock);
         void StartWriteAbleEvent(const SockFD::Ptr &sock);
@@ -182,27 +269,57 @@ namespace cyber
 
     private:
         int sock_flags_ = SOCKET_DEFAULE_FLAGS;
+        size_t accept_budget_ = ACCEPT_BUDGET;
+        size_t read_budget_bytes_ = READ_BUDGET_BYTES;
+        size_t read_budget_reads_ = READ_BUDGET_COUNT;
+        size_t read_size_ = READ_MIN_SIZE;
+        size_t read_small_ = 0;
         uint32_t max_send_buffer_ms_ = SEND_TIME_OUT_SEC * 1000;
+        size_t send_high_bytes_ = SEND_HIGH_WATERMARK;
+        size_t send_low_bytes_ = SEND_LOW_WATERMARK;
+        uint32_t send_high_ms_ = 0;
+        std::atomic<size_t> send_buf_bytes_{0};
+        std::atomic<uint64_t> send_flush_ms_{0};
+        std::atomic<bool> congested_{false};
+        std::atomic<bool> recv_paused_{false};
         std::atomic<bool> enable_recv_{true};
         std::atomic<bool> sendable_{true};
+        std::atomic<bool> udp_gso_{false};
+        std::atomic<bool> flush_pending_{false};
+        std::atomic<bool> zerocopy_{false};
+        std::atomic<bool> zerocopy_copied_{false};
+        bool owned_read_ = false;
+        std::atomic<size_t> zerocopy_min_size_{0};
 
         std::shared_ptr<std::function<void(int)>> async_con_cb_;
+        DelayTask::Ptr con_timer_;
+        // runs on the poller while the kernel buffer is full
+        DelayTask::Ptr send_timer_;
         BufferRaw::Ptr read_buffer_;
+        std::unique_ptr<UdpRecvBatch> udp_recv_;
         SockFD::Ptr sock_fd_;
         EventPoller::Ptr poller_;
-        std::recursive_mutex sock_fd_lock_;
+        MutexWrapper<std::recursive_mutex> sock_fd_lock_;
 
         OnErrorCB on_err_;
         OnReadCB on_read_;
         OnFlushCB on_flush_;
+        OnWatermarkCB on_watermark_;
         OnAcceptCB on_accept_;
-        OnCreateSocketCB on_before_accept_;
-        std::recursive_mutex event_lock_;
+        OnBeforeAcceptCB on_before_accept_;
+        MutexWrapper<std::recursive_mutex> event_lock_;
 
         List<BufferSock::Ptr> send_buf_waiting_;
-        std::recursive_mutex send_buf_waiting_lock_;
+        MutexWrapper<std::recursive_mutex> send_buf_waiting_lock_;
         List<BufferList::Ptr> send_buf_sending_;
-        std::recursive_mutex send_buf_sending_lock_;
+        MutexWrapper<std::recursive_mutex> send_buf_sending_lock_;
+        // sent lists waiting for their last zero-copy completion id. The kernel numbers the
+        // zero-copy sends of a socket from 0, every id below zerocopy_done_ has completed
+        uint32_t zerocopy_next_ = 0;
+        uint32_t zerocopy_done_ = 0;
+        std::map<uint32_t, uint32_t> zerocopy_ranges_;
+        List<std::pair<uint32_t, BufferList::Ptr>> send_buf_zerocopy_;
+        MutexWrapper<std::recursive_mutex> send_buf_zerocopy_lock_;
     };
 
     class SockSender
@@ -211,6 +328,8 @@ namespace cyber
         SockSender() = default;
         virtual ~SockSender() = default;
         virtual ssize_t Send(Buffer::Ptr buf) = 0;
+        // several buffers as one logical write
+        virtual ssize_t SendV(std::vector<Buffer::Ptr> bufs);
         virtual void Shutdown(const SockException &ex = SockException(ERR_SHUTDOWN, "self shutdown")) = 0;
 
         SockSender &operator<<(const char *buf);
@@ -227,6 +346,7 @@ namespace cyber
         }
         ssize_t Send(std::string buf);
         ssize_t Send(const char *buf, size_t size = 0);
+        ssize_t Send(const BufferChain &chain);
     };
 
     class SocketHelper : public SockSender, public TaskExecutorInterface
@@ -250,7 +370,9 @@ namespace cyber
         Task::Ptr Async(TaskIn task, bool may_sync = true) override;
         Task::Ptr AsyncFirst(TaskIn task, bool may_sync = true) override;
 
+        using SockSender::Send;
         ssize_t Send(Buffer::Ptr buf) override;
+        ssize_t SendV(std::vector<Buffer::Ptr> bufs) override;
         void Shutdown(const SockException &ex = SockException(ERR_SHUTDOWN, "self shutdown")) override;
 
     protected:
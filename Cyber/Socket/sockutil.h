@@ -8,12 +8,53 @@
 #include <string.h>
 #include <sys/unistd.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <fcntl.h>
+#include <netdb.h>
+#include <string>
+#include <vector>
+#include <linux/filter.h>
 
 #define SOCKET_DEFAULT_BUF_SIZE 256 * 1024
 
+// older libc headers lack the udp offload options (linux 4.18 / 5.0)
+#if !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+#if !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+#if !defined(SO_INCOMING_CPU)
+#define SO_INCOMING_CPU 49
+#endif
+#if !defined(SO_ATTACH_REUSEPORT_CBPF)
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+// linux 4.14
+#if !defined(SO_ZEROCOPY)
+#define SO_ZEROCOPY 60
+#endif
+#if !defined(MSG_ZEROCOPY)
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
 namespace cyber
 {
+    // options of a listening socket. Accepted sockets inherit them from the listener,
+    // so they cost nothing per connection (accept4 sets the file flags)
+    struct SockOptions
+    {
+        bool no_delay = true;
+        // 0 keeps the kernel's buffer autotuning
+        int send_buf = SOCKET_DEFAULT_BUF_SIZE;
+        int recv_buf = SOCKET_DEFAULT_BUF_SIZE;
+        int linger_sec = 0;
+        // TCP_DEFER_ACCEPT: a connection is only reported once its first data arrived
+        int defer_accept_sec = 0;
+        // TCP_FASTOPEN queue length, requests in the SYN save a round trip. 0 is off
+        int fastopen_queue = 0;
+    };
+
     class SockUtil
     {
     public:
@@ -96,6 +137,48 @@ namespace cyber
             return ret;
         }
 
+        static int setDeferAccept(int sock, int second)
+        {
+            int ret = setsockopt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, (char *)&second, sizeof(second));
+            if (ret == -1)
+            {
+                TraceL << "TCP_DEFER_ACCEPT fail";
+            }
+            return ret;
+        }
+
+        static int setFastOpen(int sock, int queue)
+        {
+            int ret = setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN, (char *)&queue, sizeof(queue));
+            if (ret == -1)
+            {
+                TraceL << "TCP_FASTOPEN fail";
+            }
+            return ret;
+        }
+
+        static void setSockOptions(int sock, const SockOptions &options)
+        {
+            setNoDelay(sock, options.no_delay);
+            if (options.send_buf)
+            {
+                setSendBuf(sock, options.send_buf);
+            }
+            if (options.recv_buf)
+            {
+                setRecvBuf(sock, options.recv_buf);
+            }
+            setCloseWait(sock, options.linger_sec);
+            if (options.defer_accept_sec)
+            {
+                setDeferAccept(sock, options.defer_accept_sec);
+            }
+            if (options.fastopen_queue)
+            {
+                setFastOpen(sock, options.fastopen_queue);
+            }
+        }
+
         static int setReuseable(int sockFd, bool on = true)
         {
             int opt = on ? 1 : 0;
@@ -113,6 +196,82 @@ namespace cyber
             return ret;
         }
 
+        static bool IsIP(const char *str)
+        {
+            in_addr addr;
+            return inet_pton(AF_INET, str, &addr) == 1;
+        }
+
+        // blocking getaddrinfo, first ipv4 address of host
+        static bool ResolveHost(const char *host, std::string &ip)
+        {
+            addrinfo hints, *result = nullptr;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result)
+            {
+                return false;
+            }
+            char buf[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &((sockaddr_in *)result->ai_addr)->sin_addr, buf, sizeof(buf));
+            freeaddrinfo(result);
+            ip = buf;
+            return true;
+        }
+
+        // allows MSG_ZEROCOPY sends on sock, completions arrive on its error queue
+        static int setZeroCopy(int sock, bool on = true)
+        {
+            int opt = on ? 1 : 0;
+            int ret = setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, (char *)&opt, sizeof(opt));
+            if (ret == -1)
+            {
+                TraceL << "SO_ZEROCOPY fail";
+            }
+            return ret;
+        }
+
+        // within a reuseport group, prefer this listener for packets handled on cpu
+        static int setIncomingCpu(int sock, int cpu)
+        {
+            int ret = setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, (char *)&cpu, sizeof(cpu));
+            if (ret == -1)
+            {
+                TraceL << "SO_INCOMING_CPU fail";
+            }
+            return ret;
+        }
+
+        // reuseport program for the whole group of sock: a packet handled on cpus[i] goes to the
+        // i-th listener of the group (in listen order), cpus of -1 are skipped and any other cpu
+        // falls back to cpu % cpus.size()
+        static int attachReusePortCpuSteering(int sock, const std::vector<int> &cpus)
+        {
+            std::vector<sock_filter> code;
+            code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)));
+            for (size_t i = 0; i < cpus.size(); ++i)
+            {
+                if (cpus[i] < 0)
+                {
+                    continue;
+                }
+                code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)cpus[i], 0, 1));
+                code.push_back(BPF_STMT(BPF_RET | BPF_K, (uint32_t)i));
+            }
+            code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)cpus.size()));
+            code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+            sock_fprog prog;
+            prog.len = (unsigned short)code.size();
+            prog.filter = code.data();
+            int ret = setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, (char *)&prog, sizeof(prog));
+            if (ret == -1)
+            {
+                TraceL << "SO_ATTACH_REUSEPORT_CBPF fail";
+            }
+            return ret;
+        }
+
         static int Connect(const char *ip, sa_family_t family, uint16_t port, bool bAsync = true)
         {
             sockaddr addr;
@@ -146,7 +305,7 @@ namespace cyber
             return -1;
         }
 
-        static int Listen(const uint16_t port, const char *local_ip = "0.0.0.0", int back_log = 1024)
+        static int Listen(const uint16_t port, const char *local_ip = "0.0.0.0", int back_log = 1024, const SockOptions &options = SockOptions())
         {
             int sockfd = -1;
             if (-1 == (sockfd = (int)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)))
@@ -155,11 +314,8 @@ namespace cyber
             }
             setReuseable(sockfd);
             SetNoBlocked(sockfd);
-            setNoDelay(sockfd);
-            setSendBuf(sockfd);
-            setRecvBuf(sockfd);
-            setCloseWait(sockfd);
             setCloExec(sockfd);
+            setSockOptions(sockfd, options);
 
             if (-1 == BindSock(sockfd, local_ip, port))
             {
@@ -176,6 +332,50 @@ namespace cyber
             return sockfd;
         }
 
+        static int BindUdpSock(const uint16_t port, const char *local_ip = "0.0.0.0", bool enable_reuse = true)
+        {
+            int sockfd = -1;
+            if (-1 == (sockfd = (int)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)))
+            {
+                throw "create udp socket failed";
+            }
+            if (enable_reuse)
+            {
+                setReuseable(sockfd);
+            }
+            SetNoBlocked(sockfd);
+            setSendBuf(sockfd);
+            setRecvBuf(sockfd);
+            setCloExec(sockfd);
+
+            if (-1 == BindSock(sockfd, local_ip, port))
+            {
+                close(sockfd);
+                return -1;
+            }
+            return sockfd;
+        }
+
+        // the kernel (or nic) cuts one large send into gso_size datagrams,
+        // probed with a per-socket size of 0, which leaves it disabled
+        static bool SupportUdpGso(int sock)
+        {
+            int size = 0;
+            return setsockopt(sock, SOL_UDP, UDP_SEGMENT, (char *)&size, sizeof(size)) == 0;
+        }
+
+        // the kernel hands a burst of one flow's datagrams up as one buffer plus its segment size
+        static int setUdpGro(int sock, bool on = true)
+        {
+            int opt = on ? 1 : 0;
+            int ret = setsockopt(sock, SOL_UDP, UDP_GRO, (char *)&opt, sizeof(opt));
+            if (ret == -1)
+            {
+                TraceL << "UDP_GRO fail";
+            }
+            return ret;
+        }
+
         static int BindSock(int sockfd, const char *ip, uint16_t port)
         {
             sockaddr_in servaddr;
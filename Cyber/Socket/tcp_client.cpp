@@ -0,0 +1,163 @@
+#if !defined(CYBER_TCP_CLIENT_CPP)
+#define CYBER_TCP_CLIENT_CPP
+
+#include <algorithm>
+
+#include "tcp_client.h"
+
+#define TCP_CLIENT_MAX_RETRY_MS 30000
+
+namespace cyber
+{
+    TCPClient::TCPClient(const EventPoller::Ptr &poller) : SocketHelper(nullptr)
+    {
+        SetPoller(poller ? poller : EventPollerPool::Instance().GetPoller());
+    }
+
+    TCPClient::~TCPClient()
+    {
+        if (reconnect_task_)
+        {
+            reconnect_task_->Cancel();
+        }
+    }
+
+    void TCPClient::StartConnect(const std::string &host, uint16_t port, float timeout_sec, Socket::OnErrorCB cb)
+    {
+        host_ = host;
+        port_ = port;
+        timeout_sec_ = timeout_sec;
+        shutdown_ = false;
+        connected_ = false;
+
+        std::weak_ptr<TCPClient> weak_self = shared_from_this();
+        timer_ = std::make_shared<Timer>(
+            2.0f, [weak_self]() -> bool
+            {
+                auto strong_self = weak_self.lock();
+                if (!strong_self)
+                {
+                    return false;
+                }
+                strong_self->OnManager();
+                return true;
+            },
+            GetPoller());
+
+        auto sock = CreateSocket();
+        sock->SetOnRead(
+            [weak_self](const Buffer::Ptr &buf, sockaddr *, int)
+            {
+                auto strong_self = weak_self.lock();
+                if (strong_self)
+                {
+                    strong_self->OnRecv(buf);
+                }
+            });
+        sock->SetOnError(
+            [weak_self](const SockException &ex)
+            {
+                auto strong_self = weak_self.lock();
+                if (strong_self)
+                {
+                    strong_self->OnSockError(ex);
+                }
+            });
+        SetSocket(sock);
+        sock->Connect(
+            host, port, [weak_self, cb](const SockException &ex)
+            {
+                auto strong_self = weak_self.lock();
+                if (strong_self)
+                {
+                    strong_self->OnSockConnect(ex, cb);
+                }
+            },
+            timeout_sec);
+    }
+
+    void TCPClient::SetReconnect(float delay_sec)
+    {
+        reconnect_ms_ = (uint64_t)(delay_sec * 1000);
+        retry_ms_ = reconnect_ms_;
+    }
+
+    void TCPClient::Shutdown(const SockException &ex)
+    {
+        shutdown_ = true;
+        connected_ = false;
+        timer_.reset();
+        if (reconnect_task_)
+        {
+            reconnect_task_->Cancel();
+            reconnect_task_ = nullptr;
+        }
+        // a connect still in flight is dropped without reporting
+        auto sock = GetSocket();
+        if (sock && !sock->EmitError(ex))
+        {
+            sock->CLoseSock();
+        }
+    }
+
+    bool TCPClient::IsConnected() const
+    {
+        auto sock = GetSocket();
+        return connected_ && sock && sock->GetFD() != -1;
+    }
+
+    void TCPClient::OnSockConnect(const SockException &ex, const Socket::OnErrorCB &cb)
+    {
+        connected_ = (bool)ex;
+        if (connected_)
+        {
+            retry_ms_ = reconnect_ms_;
+        }
+        else
+        {
+            timer_.reset();
+        }
+        OnConnect(ex);
+        if (cb)
+        {
+            cb(ex);
+        }
+        if (!connected_)
+        {
+            Reconnect();
+        }
+    }
+
+    void TCPClient::OnSockError(const SockException &ex)
+    {
+        connected_ = false;
+        timer_.reset();
+        OnError(ex);
+        Reconnect();
+    }
+
+    void TCPClient::Reconnect()
+    {
+        if (!reconnect_ms_ || shutdown_)
+        {
+            return;
+        }
+        std::weak_ptr<TCPClient> weak_self = shared_from_this();
+        auto delay = retry_ms_;
+        retry_ms_ = std::min<uint64_t>(retry_ms_ * 2, TCP_CLIENT_MAX_RETRY_MS);
+        reconnect_task_ = GetPoller()->DoDelayTask(
+            delay, [weak_self]()
+            {
+                auto strong_self = weak_self.lock();
+                if (strong_self && !strong_self->shutdown_)
+                {
+                    strong_self->reconnect_task_ = nullptr;
+                    strong_self->StartConnect(strong_self->host_, strong_self->port_, strong_self->timeout_sec_);
+                }
+                return 0;
+            });
+    }
+
+} // namespace cyberweb
+
+#endif // CYBER_TCP_CLIENT_CPP
@@ -0,0 +1,215 @@
+#if !defined(CYBER_TCP_CLIENT_H)
+#define CYBER_TCP_CLIENT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "sock.h"
+#include "../Poller/Timer.h"
+
+namespace cyber
+{
+    // client side of a tcp connection, living on one EventPoller like a server session
+    class TCPClient : public std::enable_shared_from_this<TCPClient>, public SocketHelper
+    {
+    public:
+        typedef std::shared_ptr<TCPClient> Ptr;
+        TCPClient(const EventPoller::Ptr &poller = nullptr);
+        ~TCPClient() override;
+
+        // (re)connect on the client's poller. OnConnect reports the outcome, then cb if given
+        virtual void StartConnect(const std::string &host, uint16_t port, float timeout_sec = 5, Socket::OnErrorCB cb = nullptr);
+
+        // after a failed connect or a lost connection, connect again in delay_sec,
+        // doubled on every failed attempt up to 30s. 0 disables it
+        void SetReconnect(float delay_sec);
+
+        void Shutdown(const SockException &ex = SockException(ERR_SHUTDOWN, "self shutdown")) override;
+
+        // on the client's poller
+        bool IsConnected() const;
+
+    protected:
+        virtual void OnConnect(const SockException &ex) = 0;
+        virtual void OnRecv(const Buffer::Ptr &buf) = 0;
+        virtual void OnError(const SockException &ex) = 0;
+        virtual void OnManager() {}
+
+    private:
+        void OnSockConnect(const SockException &ex, const Socket::OnErrorCB &cb);
+        void OnSockError(const SockException &ex);
+        void Reconnect();
+
+    private:
+        bool connected_ = false;
+        bool shutdown_ = false;
+        uint16_t port_ = 0;
+        float timeout_sec_ = 5;
+        uint64_t reconnect_ms_ = 0;
+        uint64_t retry_ms_ = 0;
+        std::string host_;
+        std::shared_ptr<Timer> timer_;
+        DelayTask::Ptr reconnect_task_;
+    };
+
+    // keep-alive connections to one upstream, pooled per EventPoller. A connection is handed out
+    // and returned only on its own poller, so a request never hops threads and the pool takes no lock.
+    // ClientType derives from TCPClient and is constructible from an EventPoller::Ptr.
+    template <typename ClientType>
+    class UpstreamPool : public std::enable_shared_from_this<UpstreamPool<ClientType>>
+    {
+    public:
+        typedef std::shared_ptr<UpstreamPool> Ptr;
+        typedef std::shared_ptr<ClientType> ClientPtr;
+        typedef std::function<void(const SockException &ex, const ClientPtr &client)> OnAcquireCB;
+
+        static Ptr Create(const std::string &host, uint16_t port, size_t max_idle = 8, uint32_t idle_timeout_sec = 60, float connect_timeout_sec = 5)
+        {
+            Ptr ret(new UpstreamPool(host, port, max_idle, idle_timeout_sec, connect_timeout_sec));
+            std::weak_ptr<UpstreamPool> weak_self = ret;
+            for (auto &pr : ret->shards_)
+            {
+                // the shard lives as long as the pool, which the timer checks first
+                auto shard = pr.second.get();
+                shard->timer_ = std::make_shared<Timer>(
+                    2.0f, [weak_self, shard]() -> bool
+                    {
+                        auto strong_self = weak_self.lock();
+                        if (!strong_self)
+                        {
+                            return false;
+                        }
+                        strong_self->Sweep(*shard);
+                        return true;
+                    },
+                    shard->poller_);
+            }
+            return ret;
+        }
+
+        // an idle connection of the calling poller, or a new one connected on it.
+        // Called off the pool's pollers it hops to one of them first.
+        void Acquire(OnAcquireCB cb)
+        {
+            auto poller = EventPoller::GetCurrentPoller();
+            auto it = poller ? shards_.find(poller.get()) : shards_.end();
+            if (it == shards_.end())
+            {
+                auto strong_self = this->shared_from_this();
+                EventPollerPool::Instance().GetPoller()->Async([strong_self, cb]()
+                                                               { strong_self->Acquire(cb); });
+                return;
+            }
+            auto &idle = it->second->idle_;
+            while (!idle.empty())
+            {
+                // most recently used first, its path is the warmest
+                auto client = std::move(idle.back().client);
+                idle.pop_back();
+                if (client->IsConnected())
+                {
+                    cb(SockException(ERR_SUCCESS, "success"), client);
+                    return;
+                }
+            }
+            auto client = std::make_shared<ClientType>(poller);
+            client->StartConnect(host_, port_, connect_timeout_sec_, [cb, client](const SockException &ex)
+                                 { cb(ex, ex ? client : nullptr); });
+        }
+
+        // hand a connection back once its exchange is complete
+        void Release(const ClientPtr &client)
+        {
+            auto poller = client->GetPoller();
+            if (!poller->IsCurrentThread())
+            {
+                auto strong_self = this->shared_from_this();
+                poller->Async([strong_self, client]()
+                              { strong_self->Release(client); });
+                return;
+            }
+            auto it = shards_.find(poller.get());
+            if (!client->IsConnected())
+            {
+                return;
+            }
+            if (it == shards_.end() || it->second->idle_.size() >= max_idle_)
+            {
+                client->Shutdown(SockException(ERR_SHUTDOWN, "upstream pool full"));
+                return;
+            }
+            it->second->idle_.push_back({client, poller->GetLoopMillisecond()});
+        }
+
+    private:
+        struct IdleClient
+        {
+            ClientPtr client;
+            uint64_t since_ms;
+        };
+
+        struct Shard
+        {
+            EventPoller::Ptr poller_;
+            std::vector<IdleClient> idle_;
+            std::shared_ptr<Timer> timer_;
+        };
+
+        UpstreamPool(const std::string &host, uint16_t port, size_t max_idle, uint32_t idle_timeout_sec, float connect_timeout_sec)
+            : host_(host), port_(port), max_idle_(max_idle), idle_timeout_ms_((uint64_t)idle_timeout_sec * 1000), connect_timeout_sec_(connect_timeout_sec)
+        {
+            // one shard per poller, the map is never modified afterwards
+            EventPollerPool::Instance().ForEach(
+                [&](const TaskExecutor::Ptr &executor)
+                {
+                    auto poller = std::dynamic_pointer_cast<EventPoller>(executor);
+                    if (poller)
+                    {
+                        auto shard = std::make_shared<Shard>();
+                        shard->poller_ = poller;
+                        shards_.emplace(poller.get(), shard);
+                    }
+                });
+        }
+
+        // drop idle connections the upstream closed or that sat unused too long
+        void Sweep(Shard &shard)
+        {
+            auto now = shard.poller_->GetLoopMillisecond();
+            std::vector<ClientPtr> expired;
+            auto &idle = shard.idle_;
+            size_t kept = 0;
+            for (auto &entry : idle)
+            {
+                if (!entry.client->IsConnected())
+                {
+                    continue;
+                }
+                if (now - entry.since_ms > idle_timeout_ms_)
+                {
+                    expired.emplace_back(std::move(entry.client));
+                    continue;
+                }
+                idle[kept++] = std::move(entry);
+            }
+            idle.resize(kept);
+            for (auto &client : expired)
+            {
+                client->Shutdown(SockException(ERR_TIMEOUT, "upstream connection idle timeout"));
+            }
+        }
+
+    private:
+        std::string host_;
+        uint16_t port_;
+        size_t max_idle_;
+        uint64_t idle_timeout_ms_;
+        float connect_timeout_sec_;
+        std::unordered_map<const EventPoller *, std::shared_ptr<Shard>> shards_;
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_TCP_CLIENT_H
@@ -4,6 +4,7 @@
 #include <assert.h>
 
 #include "sock.h"
+#include "sockutil.h"
 #include "../Poller/Timer.h"
 #include "server.h"
 
@@ -13,6 +14,22 @@ namespace cyber
     {
     public:
         typedef std::shared_ptr<TCPServer> Ptr;
+
+        typedef enum
+        {
+            // one listening fd shared by every poller, EPOLLEXCLUSIVE wakes one of them,
+            // the accepted connection is then placed by the PlacementPolicy
+            LISTEN_SHARED = 0,
+            // every poller listens on its own SO_REUSEPORT socket, the kernel hashes each
+            // connection to one of them and it is accepted and served on that poller
+            LISTEN_REUSEPORT,
+            // as LISTEN_REUSEPORT, each listener marked with its poller's cpu (SO_INCOMING_CPU)
+            LISTEN_REUSEPORT_INCOMING_CPU,
+            // as LISTEN_REUSEPORT, a reuseport cbpf program picks the listener of the poller
+            // pinned to the cpu that handled the packet
+            LISTEN_REUSEPORT_CBPF
+        } ListenMode;
+
         TCPServer(const EventPoller::Ptr &poller = nullptr) : Server(poller)
         {
             SetOnCreateSocket(nullptr);
@@ -25,8 +42,8 @@ namespace cyber
                                                 { server->OnAcceptConnection(sock); });
                                  });
             socket_->SetOnBeforeAccept(
-                [this](const EventPoller::Ptr &poller)
-                { return OnBeforeAcceptConnection(poller); });
+                [this](const EventPoller::Ptr &poller, const sockaddr *addr, int addr_len)
+                { return OnBeforeAcceptConnection(poller, addr, addr_len); });
         }
         ~TCPServer()
         {
@@ -44,6 +61,8 @@ namespace cyber
         void Start(uint16_t port, const std::string &host = "0.0.0.0", uint32_t backlog = 1024)
         {
             StartL<SessionType>(port, host, backlog);
+            // listener cpus in listen order, which is the order of the reuseport group
+            std::vector<int> cpus{poller_->GetCpu()};
             EventPollerPool::Instance().ForEach(
                 [&](const TaskExecutor::Ptr &executor)
                 {
@@ -60,12 +79,41 @@ namespace cyber
                     if (serverRef)
                     {
                         serverRef->CloneFrom(*this);
+                        cpus.emplace_back(poller->GetCpu());
                     }
                 });
+            if (listen_mode_ == LISTEN_REUSEPORT_CBPF && SockUtil::attachReusePortCpuSteering(socket_->GetFD(), cpus) == -1)
+            {
+                WarnL << "reuseport cpu steering is not supported, fall back to the kernel hash";
+            }
 
             // cloned_server_[poller_.get()] = std::static_pointer_cast<TCPServer>(shared_from_this());
         }
 
+        // how the listening socket is spread over the pollers, call before Start
+        void SetListenMode(ListenMode mode)
+        {
+            listen_mode_ = mode;
+        }
+
+        // options of the listener, inherited by every accepted connection, call before Start
+        void SetSockOptions(const SockOptions &options)
+        {
+            options_ = options;
+        }
+
+        // connections accepted per listener wakeup, 0 for no limit, call before Start
+        void SetAcceptBudget(size_t budget)
+        {
+            accept_budget_ = budget;
+        }
+
+        // the listening port, useful after Start(0)
+        uint16_t GetPort() const
+        {
+            return port_;
+        }
+
         void SetOnCreateSocket(Socket::OnCreateSocketCB cb)
         {
             if (cb)
@@ -85,16 +133,27 @@ namespace cyber
             }
         }
 
+        // how accepted connections are spread over the EventPollerPool, call before Start
+        void SetPlacementPolicy(EventPollerPool::PlacementPolicy policy)
+        {
+            placement_ = policy;
+        }
+
     protected:
         virtual TCPServer::Ptr OnCreateServer(const EventPoller::Ptr &poller)
         {
             return std::make_shared<TCPServer>(poller);
         }
 
-        virtual Socket::Ptr OnBeforeAcceptConnection(const EventPoller::Ptr &poller)
+        virtual Socket::Ptr OnBeforeAcceptConnection(const EventPoller::Ptr &poller, const sockaddr *addr, int addr_len)
         {
             assert(poller_->IsCurrentThread());
-            return CreateSocket(EventPollerPool::Instance().GetPoller());
+            if (listen_mode_ != LISTEN_SHARED)
+            {
+                // the kernel already chose this poller, stay on it
+                return CreateSocket(poller_);
+            }
+            return CreateSocket(EventPollerPool::Instance().GetPoller(placement_, addr));
         }
 
         virtual void CloneFrom(const TCPServer &that)
@@ -105,7 +164,20 @@ namespace cyber
             }
             on_create_socket_ = that.on_create_socket_;
             session_alloc_ = that.session_alloc_;
-            socket_->CloneFromListenSocket(that.socket_);
+            placement_ = that.placement_;
+            listen_mode_ = that.listen_mode_;
+            options_ = that.options_;
+            accept_budget_ = that.accept_budget_;
+            if (listen_mode_ == LISTEN_SHARED)
+            {
+                socket_->SetAcceptBudget(accept_budget_);
+                socket_->CloneFromListenSocket(that.socket_);
+                port_ = that.port_;
+            }
+            else
+            {
+                ListenL(that.port_, that.host_, that.backlog_);
+            }
             std::weak_ptr<TCPServer> weak_self = std::dynamic_pointer_cast<TCPServer>(shared_from_this());
             timer_ = std::make_shared<Timer>(
                 2.0f, [weak_self]() -> bool
@@ -212,10 +284,7 @@ namespace cyber
                 return std::make_shared<SessionHelper>(server, session);
             };
 
-            if (!socket_->Listen(port, host, backlog))
-            {
-                throw std::runtime_error("tcp server listen error");
-            }
+            ListenL(port, host, backlog);
 
             std::weak_ptr<TCPServer> weak_self = std::dynamic_pointer_cast<TCPServer>(shared_from_this());
             timer_ = std::make_shared<Timer>(
@@ -232,6 +301,25 @@ namespace cyber
                 poller_);
         }
 
+        void ListenL(uint16_t port, const std::string &host, uint32_t backlog)
+        {
+            socket_->SetAcceptBudget(accept_budget_);
+            if (!socket_->Listen(port, host, backlog, options_))
+            {
+                throw std::runtime_error("tcp server listen error");
+            }
+            sockaddr_in addr;
+            socklen_t addr_len = sizeof(addr);
+            getsockname(socket_->GetFD(), (sockaddr *)&addr, &addr_len);
+            port_ = ntohs(addr.sin_port);
+            host_ = host;
+            backlog_ = backlog;
+            if (listen_mode_ == LISTEN_REUSEPORT_INCOMING_CPU && poller_->GetCpu() >= 0)
+            {
+                SockUtil::setIncomingCpu(socket_->GetFD(), poller_->GetCpu());
+            }
+        }
+
         void OnManagerSession()
         {
             assert(poller_->IsCurrentThread());
@@ -282,10 +370,17 @@ namespace cyber
     private:
         /* data */
         bool is_on_manager = false;
+        uint16_t port_ = 0;
+        uint32_t backlog_ = 1024;
+        std::string host_;
+        ListenMode listen_mode_ = LISTEN_SHARED;
+        SockOptions options_;
+        size_t accept_budget_ = ACCEPT_BUDGET;
         const TCPServer *parent_ = nullptr;
         Socket::Ptr socket_;
         std::shared_ptr<Timer> timer_;
         Socket::OnCreateSocketCB on_create_socket_;
+        EventPollerPool::PlacementPolicy placement_ = EventPollerPool::PLACE_DEFAULT;
         std::unordered_map<SessionHelper *, SessionHelper::Ptr> session_map_;
         std::function<SessionHelper::Ptr(const TCPServer::Ptr &server, const Socket::Ptr &)> session_alloc_;
         std::unordered_map<const EventPoller *, Ptr> cloned_server_;
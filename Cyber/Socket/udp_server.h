@@ -0,0 +1,288 @@
+#if !defined(CYBER_UDP_SERVER_H)
+#define CYBER_UDP_SERVER_H
+
+#include <assert.h>
+#include <type_traits>
+
+#include "sock.h"
+#include "sockutil.h"
+#include "../Poller/Timer.h"
+#include "server.h"
+
+#define UDP_SESSION_TIMEOUT_SEC 30
+
+namespace cyber
+{
+    // every poller binds its own socket to the port (SO_REUSEPORT), the kernel hashes each peer
+    // to one of them, so a peer's datagrams and its session stay on one poller without locks
+    class UDPServer : public Server
+    {
+    public:
+        typedef std::shared_ptr<UDPServer> Ptr;
+        UDPServer(const EventPoller::Ptr &poller = nullptr) : Server(poller)
+        {
+            socket_ = Socket::CreateSocket(poller_, false);
+        }
+        ~UDPServer()
+        {
+            if (!parent_ && socket_->GetFD() != -1)
+            {
+                InfoL << "close udp server" << std::endl;
+            }
+            timer_.reset();
+            session_map_.clear();
+            socket_.reset();
+            cloned_server_.clear();
+        }
+
+        template <typename SessionType>
+        void Start(uint16_t port, const std::string &host = "0.0.0.0")
+        {
+            static_assert(std::is_base_of<UDPSession, SessionType>::value, "udp sessions derive from UDPSession");
+            session_alloc_ = [](const UDPServer::Ptr &server, const Socket::Ptr &sock)
+            {
+                return std::make_shared<SessionHelper>(server, std::make_shared<SessionType>(sock));
+            };
+            StartL(port, host);
+            EventPollerPool::Instance().ForEach(
+                [&](const TaskExecutor::Ptr &executor)
+                {
+                    EventPoller::Ptr poller = std::dynamic_pointer_cast<EventPoller>(executor);
+                    if (poller == poller_ || !poller)
+                    {
+                        return;
+                    }
+                    auto &serverRef = cloned_server_[poller.get()];
+                    if (!serverRef)
+                    {
+                        serverRef = OnCreateServer(poller);
+                    }
+                    if (serverRef)
+                    {
+                        serverRef->CloneFrom(*this);
+                    }
+                });
+        }
+
+        // the bound port, useful after Start(0)
+        uint16_t GetPort() const
+        {
+            return port_;
+        }
+
+        // a peer silent for this long gets OnError(ERR_TIMEOUT) and is dropped, call before Start
+        void SetSessionTimeout(uint32_t second)
+        {
+            timeout_ms_ = (uint64_t)second * 1000;
+        }
+
+        // try udp segmentation / receive offload on every socket, call before Start
+        void SetUdpOffload(bool gso, bool gro)
+        {
+            gso_ = gso;
+            gro_ = gro;
+        }
+
+    protected:
+        virtual UDPServer::Ptr OnCreateServer(const EventPoller::Ptr &poller)
+        {
+            return std::make_shared<UDPServer>(poller);
+        }
+
+        virtual void CloneFrom(const UDPServer &that)
+        {
+            session_alloc_ = that.session_alloc_;
+            timeout_ms_ = that.timeout_ms_;
+            gso_ = that.gso_;
+            gro_ = that.gro_;
+            parent_ = &that;
+            StartL(that.port_, that.host_);
+        }
+
+    private:
+        struct PeerSession
+        {
+            SessionHelper::Ptr helper;
+            uint64_t alive_ms;
+        };
+
+        void StartL(uint16_t port, const std::string &host)
+        {
+            if (!socket_->BindUdpSock(port, host, true))
+            {
+                throw std::runtime_error("udp server bind error");
+            }
+            sockaddr_in addr;
+            socklen_t addr_len = sizeof(addr);
+            getsockname(socket_->GetFD(), (sockaddr *)&addr, &addr_len);
+            port_ = ntohs(addr.sin_port);
+            host_ = host;
+            if (gso_ && !socket_->EnableUdpGso())
+            {
+                WarnL << "udp gso is not supported";
+            }
+            if (gro_ && !socket_->EnableUdpGro())
+            {
+                WarnL << "udp gro is not supported";
+            }
+
+            std::weak_ptr<UDPServer> weak_self = std::dynamic_pointer_cast<UDPServer>(shared_from_this());
+            socket_->SetOnRead(
+                [weak_self](const Buffer::Ptr &buf, sockaddr *addr, int addr_len)
+                {
+                    auto strong_self = weak_self.lock();
+                    if (strong_self)
+                    {
+                        strong_self->OnRead(buf, addr, addr_len);
+                    }
+                });
+            socket_->SetOnError(
+                [](const SockException &err)
+                {
+                    ErrorL << "udp server socket error: " << err.what();
+                });
+            timer_ = std::make_shared<Timer>(
+                2.0f, [weak_self]() -> bool
+                {
+                    auto strong_self = weak_self.lock();
+                    if (!strong_self)
+                    {
+                        return false;
+                    }
+                    strong_self->OnManagerSession();
+                    return true;
+                },
+                poller_);
+        }
+
+        void OnRead(const Buffer::Ptr &buf, sockaddr *addr, int addr_len)
+        {
+            assert(poller_->IsCurrentThread());
+            if (addr->sa_family != AF_INET)
+            {
+                return;
+            }
+            auto in = (const sockaddr_in *)addr;
+            uint64_t key = ((uint64_t)in->sin_addr.s_addr << 16) | in->sin_port;
+            auto it = session_map_.find(key);
+            if (it == session_map_.end())
+            {
+                it = CreateSession(key, addr, addr_len);
+            }
+            it->second.alive_ms = poller_->GetLoopMillisecond();
+            // OnRecv may shut the session down and erase it
+            auto session = it->second.helper->session();
+            session->OnRecv(buf);
+        }
+
+        std::unordered_map<uint64_t, PeerSession>::iterator CreateSession(uint64_t key, const sockaddr *addr, int addr_len)
+        {
+            auto helper = session_alloc_(std::dynamic_pointer_cast<UDPServer>(shared_from_this()), socket_);
+            auto session = std::static_pointer_cast<UDPSession>(helper->session());
+            memcpy(&session->peer_addr_, addr, addr_len);
+            session->peer_addr_len_ = addr_len;
+            session->AttachServer(*this);
+
+            std::weak_ptr<UDPServer> weak_self = std::dynamic_pointer_cast<UDPServer>(shared_from_this());
+            std::weak_ptr<Session> weak_session = session;
+            SessionHelper *ptr = helper.get();
+            session->on_shutdown_ = [weak_self, weak_session, key, ptr](const SockException &err)
+            {
+                auto strong_self = weak_self.lock();
+                if (strong_self)
+                {
+                    assert(strong_self->poller_->IsCurrentThread());
+                    if (!strong_self->is_on_manager)
+                    {
+                        strong_self->EraseSession(key, ptr);
+                    }
+                    else
+                    {
+                        strong_self->poller_->Async(
+                            [weak_self, key, ptr]()
+                            {
+                                auto strong_self = weak_self.lock();
+                                if (strong_self)
+                                {
+                                    strong_self->EraseSession(key, ptr);
+                                }
+                            },
+                            false);
+                    }
+                }
+                auto strong_session = weak_session.lock();
+                if (strong_session)
+                {
+                    strong_session->OnError(err);
+                }
+            };
+            return session_map_.emplace(key, PeerSession{helper, poller_->GetLoopMillisecond()}).first;
+        }
+
+        void EraseSession(uint64_t key, SessionHelper *ptr)
+        {
+            // the peer may have come back with a new session meanwhile
+            auto it = session_map_.find(key);
+            if (it != session_map_.end() && it->second.helper.get() == ptr)
+            {
+                session_map_.erase(it);
+            }
+        }
+
+        void OnManagerSession()
+        {
+            assert(poller_->IsCurrentThread());
+            std::vector<Session::Ptr> expired;
+            {
+                OnceToken once(
+                    [&]()
+                    {
+                        is_on_manager = true;
+                    },
+                    [&]()
+                    {
+                        is_on_manager = false;
+                    });
+                auto now = poller_->GetLoopMillisecond();
+                try
+                {
+                    for (auto &pr : session_map_)
+                    {
+                        auto session = pr.second.helper->session();
+                        if (timeout_ms_ && now - pr.second.alive_ms > timeout_ms_)
+                        {
+                            expired.emplace_back(std::move(session));
+                            continue;
+                        }
+                        session->OnManager();
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    ErrorL << e.what() << '\n';
+                }
+            }
+            for (auto &session : expired)
+            {
+                session->Shutdown(SockException(ERR_TIMEOUT, "udp session timeout"));
+            }
+        }
+
+    private:
+        bool is_on_manager = false;
+        bool gso_ = false;
+        bool gro_ = false;
+        uint16_t port_ = 0;
+        std::string host_;
+        uint64_t timeout_ms_ = UDP_SESSION_TIMEOUT_SEC * 1000;
+        const UDPServer *parent_ = nullptr;
+        Socket::Ptr socket_;
+        std::shared_ptr<Timer> timer_;
+        std::unordered_map<uint64_t, PeerSession> session_map_;
+        std::function<SessionHelper::Ptr(const UDPServer::Ptr &server, const Socket::Ptr &)> session_alloc_;
+        std::unordered_map<const EventPoller *, Ptr> cloned_server_;
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_UDP_SERVER_H
@@ -0,0 +1,96 @@
+#if !defined(CYBER_MPSC_QUEUE_H)
+#define CYBER_MPSC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+
+#include "../Util/util.h"
+
+namespace cyber
+{
+    template <typename T>
+    class MPSCQueue;
+
+    // intrusive hook, a queued node keeps itself alive through mpsc_hold_ until it is popped
+    template <typename T>
+    class MPSCNode
+    {
+    private:
+        template <typename>
+        friend class MPSCQueue;
+
+        T *mpsc_next_ = nullptr;
+        std::shared_ptr<T> mpsc_hold_;
+    };
+
+    // multi-producer/single-consumer queue: producers push with one CAS,
+    // the consumer detaches the whole chain with one exchange.
+    template <typename T>
+    class MPSCQueue : public noncopyable
+    {
+    public:
+        typedef MPSCNode<T> Node;
+
+        MPSCQueue() {}
+        ~MPSCQueue()
+        {
+            PopAll([](std::shared_ptr<T> &) {});
+        }
+
+        // return true if the queue was empty before this push
+        bool Push(std::shared_ptr<T> ptr)
+        {
+            T *raw = ptr.get();
+            Node *node = static_cast<Node *>(raw);
+            node->mpsc_hold_ = std::move(ptr);
+            T *head = head_.load(std::memory_order_relaxed);
+            do
+            {
+                node->mpsc_next_ = head;
+            } while (!head_.compare_exchange_weak(head, raw, std::memory_order_release, std::memory_order_relaxed));
+            return head == nullptr;
+        }
+
+        // fifo=false hands nodes out newest first, the order list.emplace_front used to give
+        template <typename FUN>
+        size_t PopAll(FUN &&fun, bool fifo = true)
+        {
+            T *head = head_.exchange(nullptr, std::memory_order_acquire);
+            if (fifo)
+            {
+                T *prev = nullptr;
+                while (head)
+                {
+                    Node *node = static_cast<Node *>(head);
+                    T *next = node->mpsc_next_;
+                    node->mpsc_next_ = prev;
+                    prev = head;
+                    head = next;
+                }
+                head = prev;
+            }
+            size_t count = 0;
+            while (head)
+            {
+                Node *node = static_cast<Node *>(head);
+                head = node->mpsc_next_;
+                node->mpsc_next_ = nullptr;
+                std::shared_ptr<T> ptr = std::move(node->mpsc_hold_);
+                fun(ptr);
+                ++count;
+            }
+            return count;
+        }
+
+        bool Empty() const
+        {
+            return head_.load(std::memory_order_acquire) == nullptr;
+        }
+
+    private:
+        std::atomic<T *> head_{nullptr};
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_MPSC_QUEUE_H
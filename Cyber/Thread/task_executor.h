@@ -1,109 +1,80 @@
 #if !defined(CYBER_TASK_EXECUTOR_H)
 #define CYBER_TASK_EXECUTOR_H
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <mutex>
 #include <vector>
 #include <thread>
+#include <typeinfo>
+#include <time.h>
 
 #include "../Util/util.h"
 #include "../Util/time_ticker.h"
 #include "../Util/onceToken.h"
+#include "mpsc_queue.h"
 
 #define LOCKGUARD(mtx) std::lock_guard<decltype(mtx)> Guard(mtx)
 
+#define LOAD_CACHE_USEC 1000
+
 namespace cyber
 {
+    // share of the last max_usec (at most max_size sleep/wake intervals) the thread spent running.
+    // Only the owning thread calls StartSleep/SleepWakeUp; it writes a fixed ring of samples with
+    // relaxed atomics, so Load() can be called from any thread without a lock and nothing allocates.
     class ThreadLoadCounter
     {
     public:
         ThreadLoadCounter(uint64_t max_size, uint64_t max_usec)
-            : max_size_(max_size), max_usec_(max_usec)
+            : max_size_(max_size ? max_size : 1), max_usec_(max_usec), samples_(new std::atomic<uint64_t>[max_size_])
         {
-            last_sleep_time_ = last_wake_time_ = GetCurrentMicrosecond();
-            max_size_ = max_size;
-            max_usec_ = max_usec;
+            state_.store(GetCurrentMicrosecond() << 1 | 1, std::memory_order_relaxed);
         }
         ~ThreadLoadCounter() {}
 
-        void StartSleep()
+        // count the thread's cpu time (CLOCK_THREAD_CPUTIME_ID) as busy instead of the wall time between
+        // SleepWakeUp and StartSleep: time lost to preemption stops counting as load and busy polling
+        // starts to. Costs two more clock reads per loop, affects threads started afterwards.
+        static void UseThreadCpuTime(bool enable)
         {
-            LOCKGUARD(mtx_);
-
-            sleeping_ = true;
-
-            auto current_time = GetCurrentMicrosecond();
-            auto run_time = current_time - last_wake_time_;
-            last_wake_time_ = current_time;
-
-            time_list_.emplace_back(run_time, false);
-
-            if (time_list_.size() > max_size_)
-            {
-                time_list_.pop_front();
-            }
+            CpuTimeFlag().store(enable, std::memory_order_relaxed);
         }
 
-        void SleepWakeUp()
+        // now is GetCurrentMicrosecond(), for a caller that has just read it anyway
+        void StartSleep(uint64_t now = GetCurrentMicrosecond())
         {
-            LOCKGUARD(mtx_);
-
-            sleeping_ = false;
-
-            auto current_time = GetCurrentMicrosecond();
-            auto sleep_time = current_time - last_sleep_time_;
-            last_sleep_time_ = current_time;
-
-            time_list_.emplace_back(sleep_time, true);
-
-            if (time_list_.size() > max_size_)
-            {
-                time_list_.pop_front();
-            }
+            Switch(true, now);
         }
 
-        int Load()
+        void SleepWakeUp(uint64_t now = GetCurrentMicrosecond())
         {
-            LOCKGUARD(mtx_);
-            uint64_t total_sleep_time = 0, total_run_time = 0;
-
-            time_list_.ForEach(
-                [&](const TimeRecord &tr)
-                {
-                    if (tr.sleep_)
-                    {
-                        total_sleep_time += tr.time_;
-                    }
-                    else
-                    {
-                        total_run_time += tr.time_;
-                    }
-                });
-
-            if (sleeping_)
-            {
-                total_sleep_time += (GetCurrentMicrosecond() - last_sleep_time_);
-            }
-            else
-            {
-                total_run_time += (GetCurrentMicrosecond() - last_wake_time_);
-            }
+            Switch(false, now);
+        }
 
-            uint64_t total_time = total_run_time + total_sleep_time;
-            while (time_list_.size() != 0 && (total_time > max_usec_ || time_list_.size() > max_size_))
+        int Load() const
+        {
+            uint64_t state = state_.load(std::memory_order_acquire);
+            uint64_t now = GetCurrentMicrosecond();
+            uint64_t since = state >> 1;
+            // the interval in progress, busy unless the thread is asleep
+            uint64_t total_time = now > since ? now - since : 0;
+            uint64_t total_run_time = (state & 1) ? 0 : total_time;
+
+            uint64_t count = count_.load(std::memory_order_acquire);
+            uint64_t size = std::min<uint64_t>(count, max_size_);
+            for (uint64_t i = 1; i <= size; ++i)
             {
-                TimeRecord &tr = time_list_.front();
-                if (tr.sleep_)
+                uint64_t sample = samples_[(count - i) % max_size_].load(std::memory_order_relaxed);
+                uint64_t time = sample & 0xFFFFFFFF;
+                if (total_time + time > max_usec_)
                 {
-                    total_sleep_time -= tr.time_;
-                }
-                else
-                {
-                    total_run_time -= tr.time_;
+                    break;
                 }
-                total_time -= tr.time_;
-                time_list_.pop_front();
+                total_time += time;
+                total_run_time += sample >> 32;
             }
             if (total_time == 0)
             {
@@ -112,29 +83,66 @@ namespace cyber
             return (int)(total_run_time * 100 / total_time);
         }
 
-    private:
-        class TimeRecord
+        // Load() recomputed at most once per LOAD_CACHE_USEC, for pickers that ask on every accept.
+        // Two threads may both refresh it, either result is fine.
+        int CachedLoad() const
         {
-        public:
-            TimeRecord(uint64_t tm, bool slp)
+            uint64_t now = GetCurrentMicrosecond();
+            if (now - cached_time_.load(std::memory_order_relaxed) >= LOAD_CACHE_USEC)
             {
-                time_ = tm;
-                sleep_ = slp;
+                cached_load_.store(Load(), std::memory_order_relaxed);
+                cached_time_.store(now, std::memory_order_relaxed);
             }
+            return cached_load_.load(std::memory_order_relaxed);
+        }
 
-        public:
-            uint64_t time_;
-            bool sleep_;
-        };
+    private:
+        static std::atomic<bool> &CpuTimeFlag()
+        {
+            static std::atomic<bool> s_flag{false};
+            return s_flag;
+        }
+
+        static uint64_t ThreadCpuMicrosecond()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+        }
+
+        // close the current interval as a sample, low 32 bits its length and high 32 bits the busy part
+        void Switch(bool sleep, uint64_t now)
+        {
+            uint64_t since = state_.load(std::memory_order_relaxed) >> 1;
+            uint64_t time = std::min<uint64_t>(now > since ? now - since : 0, 0xFFFFFFFF);
+            uint64_t run_time = sleep ? time : 0;
+            if (use_cpu_time_)
+            {
+                // the counter is built on another thread, the owner's clock is only known from here on
+                uint64_t cpu_time = ThreadCpuMicrosecond();
+                if (last_cpu_time_)
+                {
+                    run_time = std::min(cpu_time - last_cpu_time_, time);
+                }
+                last_cpu_time_ = cpu_time;
+            }
+            uint64_t count = count_.load(std::memory_order_relaxed);
+            samples_[count % max_size_].store(run_time << 32 | time, std::memory_order_relaxed);
+            count_.store(count + 1, std::memory_order_release);
+            state_.store(now << 1 | (sleep ? 1 : 0), std::memory_order_release);
+        }
 
     private:
-        uint64_t last_sleep_time_;
-        uint64_t last_wake_time_;
-        List<TimeRecord> time_list_;
-        bool sleeping_ = true;
         uint64_t max_size_;
         uint64_t max_usec_;
-        std::mutex mtx_;
+        bool use_cpu_time_ = CpuTimeFlag().load(std::memory_order_relaxed);
+        uint64_t last_cpu_time_ = 0;
+        std::unique_ptr<std::atomic<uint64_t>[]> samples_;
+        std::atomic<uint64_t> count_{0};
+        // start of the interval in progress << 1 | sleeping
+        std::atomic<uint64_t> state_;
+        mutable std::atomic<int> cached_load_{0};
+        mutable std::atomic<uint64_t> cached_time_{0};
     };
 
     class TaskCancelable : public noncopyable
@@ -149,7 +157,7 @@ namespace cyber
     class TaskCancelableImp;
 
     template <class R, class... ArgTypes>
-    class TaskCancelableImp<R(ArgTypes...)> : public TaskCancelable
+    class TaskCancelableImp<R(ArgTypes...)> : public TaskCancelable, public MPSCNode<TaskCancelableImp<R(ArgTypes...)>>
     {
     public:
         typedef std::shared_ptr<TaskCancelableImp> Ptr;
@@ -189,6 +197,13 @@ namespace cyber
             return DefaultValue<R>();
         }
 
+        // type of the wrapped callable, for diagnostics
+        const std::type_info &TargetType() const
+        {
+            auto strong_task = weak_task_.lock();
+            return strong_task ? strong_task->target_type() : typeid(void);
+        }
+
         template <typename T>
         static typename std::enable_if<std::is_void<T>::value, void>::type
         DefaultValue() {}
@@ -254,7 +269,7 @@ namespace cyber
                 thread_pos = 0;
             }
             TaskExecutor::Ptr executor_min_load = threads_[thread_pos];
-            auto min_load = executor_min_load->Load();
+            auto min_load = executor_min_load->CachedLoad();
 
             for (size_t i = 0; i < threads_.size(); ++i, ++thread_pos)
             {
@@ -262,8 +277,8 @@ namespace cyber
                 {
                     thread_pos = 0;
                 }
-                auto executor = threads_[thread_pos];
-                auto load = executor->Load();
+                auto &executor = threads_[thread_pos];
+                auto load = executor->CachedLoad();
                 if (load < min_load)
                 {
                     min_load = load;
@@ -3,6 +3,10 @@
 
 #include <thread>
 #include <memory>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "task_executor.h"
 #include "../Util/logger.h"
@@ -20,32 +24,18 @@ namespace cyber
             PRIORITY_HIGH,
             PRIORITY_HIGHEST
         };
+        // SCHED_OTHER has a single static priority, so the levels map to the thread's nice value instead.
+        // Raising priority needs CAP_SYS_NICE; only the calling thread (thread_id 0 or pthread_self) is supported.
         static bool SetPriority(Priority priority = PRIORITY_NORMAL, std::thread::native_handle_type thread_id = 0)
         {
-            static int Min = sched_get_priority_min(SCHED_OTHER);
-            if (Min == -1)
-            {
-                return false;
-            }
-            static int Max = sched_get_priority_max(SCHED_OTHER);
-            if (Max == -1)
-            {
-                return false;
-            }
-            static int Priorities[] = {
-                Min, Min + (Max - Min) / 4,
-                Min + (Max - Min) / 2, Min + (Max - Min) * 3 / 4, Max};
+            static int Nices[] = {19, 10, 0, -10, -20};
 
-            if (thread_id == 0)
+            if (thread_id != 0 && !pthread_equal(thread_id, pthread_self()))
             {
-                thread_id = pthread_self();
+                return false;
             }
-
-            sched_param params;
-
-            params.sched_priority = Priorities[priority];
-
-            return pthread_setschedparam(thread_id, SCHED_OTHER, &params) == 0;
+            pid_t tid = (pid_t)syscall(SYS_gettid);
+            return setpriority(PRIO_PROCESS, tid, Nices[priority]) == 0;
         }
     };
 
@@ -0,0 +1,135 @@
+#if !defined(CYBER_WORK_STEALING_DEQUE_H)
+#define CYBER_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "../Util/util.h"
+
+namespace cyber
+{
+    // Chase-Lev deque (the C11 formulation of Le et al., PPoPP'13): the owner pushes and pops
+    // at the bottom without contention, other threads steal from the top with one CAS.
+    // T must be trivially copyable, callers store pointers.
+    template <typename T>
+    class WorkStealingDeque : public noncopyable
+    {
+    public:
+        WorkStealingDeque(size_t capacity = 256)
+        {
+            size_t size = 1;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            arrays_.emplace_back(new Array(size));
+            array_.store(arrays_.back().get(), std::memory_order_relaxed);
+        }
+
+        // owner only
+        void Push(T item)
+        {
+            int64_t bottom = bottom_.load(std::memory_order_relaxed);
+            int64_t top = top_.load(std::memory_order_acquire);
+            Array *array = array_.load(std::memory_order_relaxed);
+            if (bottom - top > (int64_t)array->mask_)
+            {
+                array = Grow(array, top, bottom);
+            }
+            array->Put(bottom, item);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        // owner only, newest first
+        bool Pop(T &item)
+        {
+            int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+            Array *array = array_.load(std::memory_order_relaxed);
+            bottom_.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = top_.load(std::memory_order_relaxed);
+            if (top > bottom)
+            {
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+                return false;
+            }
+            item = array->Get(bottom);
+            if (top == bottom)
+            {
+                // last item, race the thieves for it
+                bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+                return won;
+            }
+            return true;
+        }
+
+        // any thread, oldest first; false when empty or another thief won the race
+        bool Steal(T &item)
+        {
+            int64_t top = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = bottom_.load(std::memory_order_acquire);
+            if (top >= bottom)
+            {
+                return false;
+            }
+            Array *array = array_.load(std::memory_order_acquire);
+            item = array->Get(top);
+            return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+        bool Empty() const
+        {
+            return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        class Array
+        {
+        public:
+            Array(size_t size) : mask_(size - 1), items_(new std::atomic<T>[size]) {}
+
+            T Get(int64_t index) const
+            {
+                return items_[index & mask_].load(std::memory_order_relaxed);
+            }
+
+            void Put(int64_t index, T item)
+            {
+                items_[index & mask_].store(item, std::memory_order_relaxed);
+            }
+
+        public:
+            size_t mask_;
+            std::unique_ptr<std::atomic<T>[]> items_;
+        };
+
+        Array *Grow(Array *array, int64_t top, int64_t bottom)
+        {
+            // a thief may still read the old array, so it is retired only with the deque
+            arrays_.emplace_back(new Array((array->mask_ + 1) * 2));
+            Array *bigger = arrays_.back().get();
+            for (int64_t i = top; i < bottom; ++i)
+            {
+                bigger->Put(i, array->Get(i));
+            }
+            array_.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+
+    private:
+        // thieves hammer top_, keep it off the owner's cache line
+        std::atomic<int64_t> top_{0};
+        char pad_[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> bottom_{0};
+        std::atomic<Array *> array_;
+        std::vector<std::unique_ptr<Array>> arrays_;
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_WORK_STEALING_DEQUE_H
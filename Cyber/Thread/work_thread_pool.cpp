@@ -0,0 +1,246 @@
+#if !defined(CYBER_WORK_THREAD_POOL_CPP)
+#define CYBER_WORK_THREAD_POOL_CPP
+
+#include "work_thread_pool.h"
+#include "thread_pool.h"
+#include "../Util/cpu_info.h"
+#include "../Util/logger.h"
+
+namespace cyber
+{
+    static thread_local WorkThread *s_current_worker = nullptr;
+
+    WorkThread::WorkThread(WorkThreadPool *pool) : pool_(pool)
+    {
+        seed_ = (uint32_t)(uintptr_t)this;
+    }
+
+    WorkThread::~WorkThread()
+    {
+        Stop();
+        Task::Ptr *box;
+        while (deque_.Pop(box))
+        {
+            delete box;
+        }
+    }
+
+    void WorkThread::Start()
+    {
+        Semaphore started;
+        thread_ = std::thread([this, &started]()
+                              {
+                                  s_current_worker = this;
+                                  started.Post();
+                                  RunLoop();
+                              });
+        started.Wait();
+    }
+
+    void WorkThread::Stop()
+    {
+        if (!thread_.joinable())
+        {
+            return;
+        }
+        exit_flag_ = true;
+        sem_.Post();
+        thread_.join();
+    }
+
+    bool WorkThread::IsCurrentThread()
+    {
+        return s_current_worker == this;
+    }
+
+    Task::Ptr WorkThread::Async(TaskIn task, bool may_sync)
+    {
+        if (may_sync && IsCurrentThread())
+        {
+            task();
+            return nullptr;
+        }
+        auto ret = std::make_shared<Task>(std::move(task));
+        if (IsCurrentThread())
+        {
+            PushLocal(ret);
+            return ret;
+        }
+        inbox_.Push(ret);
+        Wake();
+        return ret;
+    }
+
+    void WorkThread::PushLocal(Task::Ptr task)
+    {
+        deque_.Push(new Task::Ptr(std::move(task)));
+        // pairs with the fence in RunLoop: either the sleeper sees this push or we see it idle
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (pool_->idle_.load(std::memory_order_relaxed) > 0)
+        {
+            pool_->WakeIdle();
+        }
+    }
+
+    bool WorkThread::Wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.exchange(false, std::memory_order_acq_rel))
+        {
+            sem_.Post();
+            return true;
+        }
+        return false;
+    }
+
+    bool WorkThread::NextTask(Task::Ptr &task)
+    {
+        Task::Ptr *box;
+        if (deque_.Pop(box))
+        {
+            task = std::move(*box);
+            delete box;
+            return true;
+        }
+        // newest first into the deque, so the oldest is popped first and stolen last
+        size_t count = inbox_.PopAll([this](Task::Ptr &item)
+                                     { deque_.Push(new Task::Ptr(std::move(item))); },
+                                     false);
+        if (count)
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (count > 1 && pool_->idle_.load(std::memory_order_relaxed) > 0)
+            {
+                pool_->WakeIdle();
+            }
+            return NextTask(task);
+        }
+        auto &workers = pool_->workers_;
+        size_t start = (seed_ = seed_ * 1103515245 + 12345) % workers.size();
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            auto victim = workers[(start + i) % workers.size()];
+            if (victim != this && victim->deque_.Steal(box))
+            {
+                task = std::move(*box);
+                delete box;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool WorkThread::HasWork()
+    {
+        if (!deque_.Empty() || !inbox_.Empty())
+        {
+            return true;
+        }
+        for (auto worker : pool_->workers_)
+        {
+            if (!worker->deque_.Empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkThread::RunLoop()
+    {
+        ThreadPool::SetPriority(ThreadPool::PRIORITY_LOWEST);
+        Task::Ptr task;
+        while (!exit_flag_)
+        {
+            if (NextTask(task))
+            {
+                try
+                {
+                    (*task)();
+                }
+                catch (const std::exception &e)
+                {
+                    ErrorL << "WorkThreadPool execute task error: " << e.what();
+                }
+                task = nullptr;
+                continue;
+            }
+            // announce the sleep first and look again, a producer that missed the flag pushed before the second look
+            sleeping_.store(true, std::memory_order_relaxed);
+            pool_->idle_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!HasWork() && !exit_flag_)
+            {
+                StartSleep();
+                sem_.Wait();
+                SleepWakeUp();
+            }
+            sleeping_.store(false, std::memory_order_relaxed);
+            pool_->idle_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    static int s_pool_size = 0;
+
+    WorkThreadPool &WorkThreadPool::Instance()
+    {
+        static std::shared_ptr<WorkThreadPool> s_instance(new WorkThreadPool());
+        static WorkThreadPool &s_ref = *s_instance;
+        return s_ref;
+    }
+
+    void WorkThreadPool::SetPoolSize(int size)
+    {
+        s_pool_size = size;
+    }
+
+    WorkThreadPool::WorkThreadPool()
+    {
+        auto size = s_pool_size > 0 ? s_pool_size : GetEffectiveCpuCount();
+        // every worker must be in workers_ before any of them starts looking for victims
+        CreateThreads([this]()
+                      {
+                          WorkThread::Ptr ret(new WorkThread(this));
+                          workers_.emplace_back(ret.get());
+                          return ret;
+                      },
+                      size);
+        for (auto worker : workers_)
+        {
+            worker->Start();
+        }
+        InfoL << "create WorkThreadPool size: " << size;
+    }
+
+    WorkThreadPool::~WorkThreadPool()
+    {
+        for (auto worker : workers_)
+        {
+            worker->Stop();
+        }
+    }
+
+    Task::Ptr WorkThreadPool::Async(TaskIn task, bool may_sync)
+    {
+        if (s_current_worker && s_current_worker->pool_ == this)
+        {
+            return s_current_worker->Async(std::move(task), may_sync);
+        }
+        auto index = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        return workers_[index]->Async(std::move(task), may_sync);
+    }
+
+    void WorkThreadPool::WakeIdle()
+    {
+        for (auto worker : workers_)
+        {
+            if (worker->Wake())
+            {
+                return;
+            }
+        }
+    }
+
+} // namespace cyberweb
+
+#endif // CYBER_WORK_THREAD_POOL_CPP
@@ -0,0 +1,149 @@
+#if !defined(CYBER_WORK_THREAD_POOL_H)
+#define CYBER_WORK_THREAD_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "task_executor.h"
+#include "mpsc_queue.h"
+#include "semaphore.h"
+#include "work_stealing_deque.h"
+#include "../Poller/poller.h"
+
+namespace cyber
+{
+    class WorkThreadPool;
+
+    // one worker: tasks it creates itself go to its own deque where idle workers can steal them,
+    // tasks handed in from other threads arrive through an mpsc inbox
+    class WorkThread : public TaskExecutor
+    {
+    public:
+        typedef std::shared_ptr<WorkThread> Ptr;
+
+        ~WorkThread();
+
+        Task::Ptr Async(TaskIn task, bool may_sync = true) override;
+
+        bool IsCurrentThread();
+
+    private:
+        friend class WorkThreadPool;
+
+        WorkThread(WorkThreadPool *pool);
+
+        void Start();
+
+        void Stop();
+
+        void RunLoop();
+
+        bool NextTask(Task::Ptr &task);
+
+        bool HasWork();
+
+        void PushLocal(Task::Ptr task);
+
+        bool Wake();
+
+    private:
+        WorkThreadPool *pool_;
+        WorkStealingDeque<Task::Ptr *> deque_;
+        MPSCQueue<Task> inbox_;
+        std::atomic<bool> sleeping_{false};
+        std::atomic<bool> exit_flag_{false};
+        Semaphore sem_;
+        std::thread thread_;
+        uint32_t seed_;
+    };
+
+    // pool of low priority threads for cpu bound work, so it stays off the EventPoller loops
+    class WorkThreadPool : public TaskExecutorGetterImp, public TaskExecutorInterface, public std::enable_shared_from_this<WorkThreadPool>
+    {
+    public:
+        typedef std::shared_ptr<WorkThreadPool> Ptr;
+
+        ~WorkThreadPool();
+
+        static WorkThreadPool &Instance();
+
+        // 0 sizes the pool from the effective cpu count, call before the first Instance()
+        static void SetPoolSize(int size = 0);
+
+        // from a worker the task goes to that worker's own deque, otherwise to the next worker in turn
+        Task::Ptr Async(TaskIn task, bool may_sync = true) override;
+
+        // run job on the pool, then call done with its result on resume,
+        // by default the EventPoller that called AsyncThen (or the worker itself if there is none)
+        template <typename JOB, typename DONE>
+        Task::Ptr AsyncThen(JOB job, DONE done, TaskExecutor::Ptr resume = nullptr)
+        {
+            if (!resume)
+            {
+                resume = EventPoller::GetCurrentPoller();
+            }
+            std::weak_ptr<TaskExecutor> weak_resume = resume;
+            bool has_resume = (bool)resume;
+            return Async(
+                [job, done, weak_resume, has_resume]() mutable
+                {
+                    RunThen(job, done, weak_resume, has_resume, std::is_void<decltype(job())>());
+                },
+                false);
+        }
+
+    private:
+        WorkThreadPool();
+
+        void WakeIdle();
+
+        template <typename JOB, typename DONE>
+        static void RunThen(JOB &job, DONE &done, const std::weak_ptr<TaskExecutor> &weak_resume, bool has_resume, std::false_type)
+        {
+            auto result = std::make_shared<decltype(job())>(job());
+            if (!has_resume)
+            {
+                done(std::move(*result));
+                return;
+            }
+            auto resume = weak_resume.lock();
+            if (resume)
+            {
+                resume->Async([done, result]() mutable
+                              { done(std::move(*result)); },
+                              false);
+            }
+        }
+
+        template <typename JOB, typename DONE>
+        static void RunThen(JOB &job, DONE &done, const std::weak_ptr<TaskExecutor> &weak_resume, bool has_resume, std::true_type)
+        {
+            job();
+            if (!has_resume)
+            {
+                done();
+                return;
+            }
+            auto resume = weak_resume.lock();
+            if (resume)
+            {
+                resume->Async([done]() mutable
+                              { done(); },
+                              false);
+            }
+        }
+
+    private:
+        friend class WorkThread;
+
+        std::vector<WorkThread *> workers_;
+        std::atomic<size_t> next_worker_{0};
+        std::atomic<int> idle_{0};
+    };
+
+} // namespace cyberweb
+
+#endif // CYBER_WORK_THREAD_POOL_H
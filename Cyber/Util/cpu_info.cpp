@@ -0,0 +1,221 @@
+#if !defined(CYBER_CPU_INFO_CPP)
+#define CYBER_CPU_INFO_CPP
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "cpu_info.h"
+#include "util.h"
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+namespace cyber
+{
+    static std::string ReadLine(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return trim(line);
+    }
+
+    static bool FileExists(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0;
+    }
+
+    static std::string ParentCgroup(const std::string &path)
+    {
+        auto pos = path.find_last_of('/');
+        return (pos == std::string::npos || pos == 0) ? std::string() : path.substr(0, pos);
+    }
+
+    static int QuotaToCpus(double quota, double period)
+    {
+        if (quota <= 0 || period <= 0)
+        {
+            return 0;
+        }
+        int cpus = (int)(quota / period);
+        return quota > cpus * period ? cpus + 1 : cpus;
+    }
+
+    static int TighterLimit(int current, int limit)
+    {
+        if (!limit)
+        {
+            return current;
+        }
+        return current ? std::min(current, limit) : limit;
+    }
+
+    // cgroup v2: "<quota> <period>" or "max <period>" in cpu.max, every ancestor may limit as well
+    static int CgroupV2CpuLimit(std::string path)
+    {
+        int ret = 0;
+        while (true)
+        {
+            auto dir = std::string(CGROUP_ROOT) + path;
+            if (FileExists(dir + "/cpu.max"))
+            {
+                auto fields = split(ReadLine(dir + "/cpu.max"), " ");
+                if (fields.size() == 2 && fields[0] != "max")
+                {
+                    ret = TighterLimit(ret, QuotaToCpus(atof(fields[0].data()), atof(fields[1].data())));
+                }
+            }
+            if (path.empty() || path == "/")
+            {
+                break;
+            }
+            path = ParentCgroup(path);
+        }
+        return ret;
+    }
+
+    // cgroup v1: cfs_quota_us of -1 means unlimited. Inside a container the cgroup path from
+    // /proc/self/cgroup is usually not visible and the hierarchy root is the container's own cgroup.
+    static int CgroupV1CpuLimit(std::string path)
+    {
+        for (auto mount : {CGROUP_ROOT "/cpu,cpuacct", CGROUP_ROOT "/cpu"})
+        {
+            if (!FileExists(std::string(mount) + "/cpu.cfs_quota_us"))
+            {
+                continue;
+            }
+            if (!FileExists(mount + path + "/cpu.cfs_quota_us"))
+            {
+                path.clear();
+            }
+            int ret = 0;
+            while (true)
+            {
+                auto dir = mount + path;
+                ret = TighterLimit(ret, QuotaToCpus(atof(ReadLine(dir + "/cpu.cfs_quota_us").data()),
+                                                    atof(ReadLine(dir + "/cpu.cfs_period_us").data())));
+                if (path.empty() || path == "/")
+                {
+                    break;
+                }
+                path = ParentCgroup(path);
+            }
+            return ret;
+        }
+        return 0;
+    }
+
+    int GetCgroupCpuLimit()
+    {
+        std::ifstream file("/proc/self/cgroup");
+        std::string line, v1_path, v2_path;
+        bool v2 = false;
+        while (std::getline(file, line))
+        {
+            // hierarchy-id:controller-list:path
+            auto first = line.find(':');
+            auto second = line.find(':', first + 1);
+            if (first == std::string::npos || second == std::string::npos)
+            {
+                continue;
+            }
+            auto controllers = line.substr(first + 1, second - first - 1);
+            auto path = line.substr(second + 1);
+            if (line.compare(0, first, "0") == 0 && controllers.empty())
+            {
+                v2 = true;
+                v2_path = path;
+                continue;
+            }
+            for (auto &controller : split(controllers, ","))
+            {
+                if (controller == "cpu")
+                {
+                    v1_path = path;
+                }
+            }
+        }
+        if (v2 && FileExists(CGROUP_ROOT "/cgroup.controllers"))
+        {
+            return CgroupV2CpuLimit(v2_path);
+        }
+        return CgroupV1CpuLimit(v1_path);
+    }
+
+    std::vector<int> GetAffinityCpus()
+    {
+        std::vector<int> ret;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    ret.emplace_back(cpu);
+                }
+            }
+        }
+        if (ret.empty())
+        {
+            for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+            {
+                ret.emplace_back(cpu);
+            }
+        }
+        return ret;
+    }
+
+    int GetEffectiveCpuCount()
+    {
+        int ret = (int)GetAffinityCpus().size();
+        int limit = GetCgroupCpuLimit();
+        if (limit && limit < ret)
+        {
+            ret = limit;
+        }
+        return ret > 0 ? ret : 1;
+    }
+
+    int GetCpuNumaNode(int cpu)
+    {
+        auto dir_path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        DIR *dir = opendir(dir_path.data());
+        if (!dir)
+        {
+            return 0;
+        }
+        int ret = 0;
+        while (dirent *entry = readdir(dir))
+        {
+            // the cpu directory holds a nodeN link to its numa node
+            if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+            {
+                ret = atoi(entry->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+        return ret;
+    }
+
+    bool SetThreadAffinity(int cpu)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+
+} // namespace cyberweb
+
+#endif // CYBER_CPU_INFO_CPP
@@ -0,0 +1,26 @@
+#if !defined(CYBER_CPU_INFO_H)
+#define CYBER_CPU_INFO_H
+
+#include <vector>
+
+namespace cyber
+{
+    // cpus the process may run on (sched_getaffinity), in ascending order
+    std::vector<int> GetAffinityCpus();
+
+    // cpu quota of the process's cgroup (v2 cpu.max or v1 cfs quota, the tightest along the path)
+    // rounded up to whole cpus, 0 when there is no quota
+    int GetCgroupCpuLimit();
+
+    // number of cpus the process can actually keep busy: the affinity mask capped by the cgroup quota
+    int GetEffectiveCpuCount();
+
+    // numa node of a cpu from sysfs, 0 when the topology is unknown
+    int GetCpuNumaNode(int cpu);
+
+    // pin the calling thread to one cpu
+    bool SetThreadAffinity(int cpu);
+
+} // namespace cyberweb
+
+#endif // CYBER_CPU_INFO_H
@@ -11,49 +11,75 @@ namespace cyber
     class Ticker
     {
     public:
-        Ticker(uint64_t min_ms = 0, LogContextCapturer ctx = LogContextCapturer(Logger::Instance(), LWARN, __FILE__, "", __LINE__), bool print_log = false) : ctx_(std::move(ctx))
+        // a plain Ticker builds no log context, so it costs two clock reads and no allocation
+        Ticker(uint64_t min_ms = 0)
         {
-            if (!print_log)
+            created_ = begin_ = Now();
+            min_ms_ = min_ms;
+        }
+
+        // with print_log, warn through ctx on destruction when more than min_ms has passed
+        Ticker(uint64_t min_ms, LogContextCapturer ctx, bool print_log = false) : Ticker(min_ms)
+        {
+            if (print_log)
             {
-                ctx_.Clear();
+                ctx_ = std::make_shared<LogContextCapturer>(ctx);
+            }
+            else
+            {
+                ctx.Clear();
             }
-            created_ = begin_ = GetCurrentMillisecond();
-            min_ms_ = min_ms;
         }
+
         ~Ticker()
         {
+            if (!ctx_)
+            {
+                return;
+            }
             uint64_t tm = CreatedTime();
             if (tm > min_ms_)
             {
-                ctx_ << "take time:" << tm << "ms"
-                     << ",thread may be overloaded";
+                *ctx_ << "take time:" << tm << "ms"
+                      << ",thread may be overloaded";
             }
             else
             {
-                ctx_.Clear();
+                ctx_->Clear();
             }
         };
 
         uint64_t EleapsedTime() const
         {
-            return GetCurrentMillisecond() - begin_;
+            return Now() - begin_;
         }
 
         uint64_t CreatedTime() const
         {
-            return GetCurrentMillisecond() - created_;
+            return Now() - created_;
         }
 
         void ResetTime()
         {
-            begin_ = GetCurrentMillisecond();
+            begin_ = Now();
+        }
+
+    private:
+        // build with ENABLE_TSC_TICKER to read the tsc instead of the vdso clock
+        static uint64_t Now()
+        {
+#if defined(ENABLE_TSC_TICKER) && defined(__x86_64__)
+            return GetTscMillisecond();
+#else
+            return GetCurrentMillisecond();
+#endif
         }
 
     private:
         uint64_t min_ms_;
         uint64_t begin_;
         uint64_t created_;
-        LogContextCapturer ctx_;
+        LogContextCapturer::Ptr ctx_;
     };
 
     class SmoothTicker
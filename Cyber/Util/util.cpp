@@ -5,71 +5,75 @@
 #include "onceToken.h"
 #include "string.h"
 
+#include <time.h>
+#if defined(ENABLE_TSC_TICKER) && defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 namespace cyber
 {
-    static inline uint64_t GetCurrentMicrosecondOrigin()
+    // CLOCK_MONOTONIC and CLOCK_REALTIME are served by the vdso, a few tens of ns and no syscall
+    static inline uint64_t ClockMicrosecond(clockid_t clock)
     {
-        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
     }
 
-    static std::atomic<uint64_t> s_current_microsecond(0);
-    static std::atomic<uint64_t> s_current_millisecond(0);
-    static std::atomic<uint64_t> s_current_microsecond_system(GetCurrentMicrosecondOrigin());
-    static std::atomic<uint64_t> s_current_millisecond_system(GetCurrentMicrosecondOrigin() / 1000);
-    static inline bool InitMillisecondThread()
+    uint64_t GetCurrentMillisecond(bool system_time)
     {
-        static std::thread s_thread(
-            []()
-            {
-                uint64_t last = GetCurrentMicrosecondOrigin();
-                uint64_t now;
-                uint64_t microsecond = 0;
-                while (true)
-                {
-                    now = GetCurrentMicrosecondOrigin();
-
-                    s_current_microsecond_system.store(now, std::memory_order_release);
-                    s_current_millisecond_system.store(now / 1000, std::memory_order_release);
+        return ClockMicrosecond(system_time ? CLOCK_REALTIME : CLOCK_MONOTONIC) / 1000;
+    }
 
-                    int64_t expired = now - last;
-                    last = now;
-                    if (expired > 0 && expired < 1000 * 1000)
-                    {
-                        microsecond += expired;
-                        s_current_microsecond.store(microsecond, std::memory_order_release);
-                        s_current_millisecond.store(microsecond / 1000, std::memory_order_release);
-                    }
-                    else if (expired != 0)
-                    {
-                        std::cerr << "Stamp expired is not abnormal" << expired;
-                    }
-                    usleep(500);
-                }
-            });
-        static OnceToken s_token([]()
-                                 { s_thread.detach(); });
-        return true;
+    uint64_t GetCurrentMicrosecond(bool system_time)
+    {
+        return ClockMicrosecond(system_time ? CLOCK_REALTIME : CLOCK_MONOTONIC);
     }
 
-    uint64_t GetCurrentMillisecond(bool system_time)
+#if defined(ENABLE_TSC_TICKER) && defined(__x86_64__)
+    // calibrated against CLOCK_MONOTONIC once TSC_CALIBRATE_USEC have passed since the first call,
+    // until then the clock itself answers
+#define TSC_CALIBRATE_USEC 50000
+#define TSC_SHIFT 32
+
+    static bool InvariantTsc()
     {
-        static bool flag = InitMillisecondThread();
-        if (system_time)
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
         {
-            return s_current_millisecond_system.load(std::memory_order_acquire);
+            return false;
         }
-        return s_current_millisecond.load(std::memory_order_acquire);
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        return edx & (1 << 8);
     }
 
-    uint64_t GetCurrentMicrosecond(bool system_time)
+    uint64_t GetTscMillisecond()
     {
-        static bool flag = InitMillisecondThread();
-        if (system_time)
+        static const bool s_invariant = InvariantTsc();
+        static const uint64_t s_start_tsc = __rdtsc();
+        static const uint64_t s_start_usec = ClockMicrosecond(CLOCK_MONOTONIC);
+        // usec per tick << TSC_SHIFT, 0 until calibrated
+        static std::atomic<uint64_t> s_mult{0};
+        if (!s_invariant)
         {
-            return s_current_microsecond_system.load(std::memory_order_acquire);
+            return GetCurrentMillisecond();
+        }
+        uint64_t mult = s_mult.load(std::memory_order_relaxed);
+        uint64_t tsc = __rdtsc();
+        if (!mult)
+        {
+            uint64_t now = ClockMicrosecond(CLOCK_MONOTONIC);
+            if (now - s_start_usec < TSC_CALIBRATE_USEC || tsc <= s_start_tsc)
+            {
+                return now / 1000;
+            }
+            mult = (uint64_t)(((unsigned __int128)(now - s_start_usec) << TSC_SHIFT) / (tsc - s_start_tsc));
+            s_mult.store(mult, std::memory_order_relaxed);
         }
-        return s_current_microsecond.load(std::memory_order_acquire);
+        return (s_start_usec + (uint64_t)(((unsigned __int128)(tsc - s_start_tsc) * mult) >> TSC_SHIFT)) / 1000;
     }
+#endif
 
     struct tm GetLocalTime(time_t sec)
     {
@@ -5,6 +5,7 @@
 #include <chrono>
 #include <atomic>
 #include <thread>
+#include <mutex>
 #include <iostream>
 #include <unistd.h>
 #include <string>
@@ -48,6 +49,37 @@ namespace cyber
         noncopyable &operator=(noncopyable &&that) = delete;
     };
 
+    // a mutex that locks nothing when disabled, for objects only ever touched from one thread
+    template <class Mtx = std::recursive_mutex>
+    class MutexWrapper : public noncopyable
+    {
+    public:
+        MutexWrapper(bool enable = true) : enable_(enable) {}
+
+        void lock()
+        {
+            if (enable_)
+            {
+                mtx_.lock();
+            }
+        }
+        void unlock()
+        {
+            if (enable_)
+            {
+                mtx_.unlock();
+            }
+        }
+        bool Enabled() const
+        {
+            return enable_;
+        }
+
+    private:
+        bool enable_;
+        Mtx mtx_;
+    };
+
     template <typename T>
     class List
     {
@@ -65,7 +97,7 @@ namespace cyber
         template <typename FUN>
         void ForEach(FUN &&fun)
         {
-            for (auto ele : list_)
+            for (auto &ele : list_)
             {
                 fun(ele);
             }
@@ -116,6 +148,10 @@ namespace cyber
         {
             list_.pop_back();
         }
+        void clear()
+        {
+            list_.clear();
+        }
         void swap(List<T> &other)
         {
             list_.swap(other.list_);
@@ -129,10 +165,16 @@ namespace cyber
         std::list<T> list_;
     };
 
+    // monotonic time, or wall time since the epoch with system_time, read straight from the vdso clock
     uint64_t GetCurrentMillisecond(bool system_time = false);
 
     uint64_t GetCurrentMicrosecond(bool system_time = false);
 
+#if defined(ENABLE_TSC_TICKER) && defined(__x86_64__)
+    // monotonic ms from rdtsc where the tsc is invariant, for Ticker
+    uint64_t GetTscMillisecond();
+#endif
+
     std::string ExePath();
 
     std::string ExeName();
@@ -1,8 +1,8 @@
 #include <signal.h>
-#include "../Cyber/logger.h"
-#include "../Cyber/time_ticker.h"
-#include "../Cyber/onceToken.h"
-#include "../Cyber/poller.h"
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Util/time_ticker.h"
+#include "../Cyber/Util/onceToken.h"
+#include "../Cyber/Poller/poller.h"
 
 int main(int argc, char const *argv[])
 {
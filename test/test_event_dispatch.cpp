@@ -0,0 +1,63 @@
+#include <signal.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <vector>
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Util/time_ticker.h"
+#include "../Cyber/Poller/poller.h"
+
+// keeps FD_COUNT level triggered fds readable so every epoll_wait returns a full batch,
+// and reports how many callbacks the poller dispatches per second.
+#define FD_COUNT 512
+#define SECONDS 5
+
+int main(int argc, char const *argv[])
+{
+    cyber::Logger::Instance().Add(std::make_shared<cyber::ConsoleChannel>());
+    cyber::Logger::Instance().SetWriter(std::make_shared<cyber::AsyncLogWriter>());
+
+    auto poller = cyber::EventPollerPool::Instance().GetPoller();
+    std::vector<int> fds;
+    static std::atomic<uint64_t> dispatched{0};
+    for (int i = 0; i < FD_COUNT; ++i)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1)
+        {
+            ErrorL << "socketpair failed: " << get_uv_errmsg();
+            return -1;
+        }
+        send(pair[1], "x", 1, 0);
+        fds.emplace_back(pair[0]);
+        fds.emplace_back(pair[1]);
+        poller->AddEvent(pair[0], cyber::EVENT_READ | cyber::EVENT_LT, [](int event)
+                         { dispatched.fetch_add(1, std::memory_order_relaxed); });
+    }
+
+    cyber::Ticker ticker;
+    uint64_t last = 0;
+    for (int i = 0; i < SECONDS; ++i)
+    {
+        sleep(1);
+        uint64_t now = dispatched.load(std::memory_order_relaxed);
+        InfoL << "dispatched " << (now - last) * 1000 / ticker.EleapsedTime() << " events/s";
+        last = now;
+        ticker.ResetTime();
+    }
+
+    cyber::Semaphore sem;
+    for (size_t i = 0; i < fds.size(); i += 2)
+    {
+        int peer = fds[i + 1];
+        poller->DelEvent(fds[i], [&sem, &fds, i, peer](bool success)
+                         {
+                             close(fds[i]);
+                             close(peer);
+                             sem.Post(); });
+    }
+    for (size_t i = 0; i < fds.size(); i += 2)
+    {
+        sem.Wait();
+    }
+    return 0;
+}
@@ -1,10 +1,10 @@
 #include <signal.h>
 #include <iostream>
-#include "../Cyber/logger.h"
-#include "../Cyber/time_ticker.h"
-#include "../Cyber/onceToken.h"
-#include "../Cyber/poller.h"
-#include "../Cyber/util.h"
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Util/time_ticker.h"
+#include "../Cyber/Util/onceToken.h"
+#include "../Cyber/Poller/poller.h"
+#include "../Cyber/Util/util.h"
 
 int main(int argc, char const *argv[])
 {
@@ -0,0 +1,125 @@
+#include <unistd.h>
+#include <signal.h>
+
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Socket/tcp_server.h"
+#include "../Cyber/Socket/tcp_client.h"
+#include "../Cyber/Util/time_ticker.h"
+
+class EchoSession : public cyber::TCPSession
+{
+public:
+    EchoSession(const cyber::Socket::Ptr &sock) : cyber::TCPSession(sock) {}
+    virtual void OnRecv(const cyber::Buffer::Ptr &buf) override
+    {
+        Send(buf);
+    }
+    virtual void OnError(const cyber::SockException &err) override {}
+    virtual void OnManager() override {}
+};
+
+// one request in flight per connection, the reply hands it back to the pool
+class EchoClient : public cyber::TCPClient
+{
+public:
+    typedef std::shared_ptr<EchoClient> Ptr;
+    EchoClient(const cyber::EventPoller::Ptr &poller) : cyber::TCPClient(poller)
+    {
+        ++s_connections;
+    }
+    void Request(const std::string &msg, std::function<void(const std::string &reply)> cb)
+    {
+        on_reply_ = std::move(cb);
+        Send(msg);
+    }
+
+    static std::atomic<int> s_connections;
+
+protected:
+    void OnConnect(const cyber::SockException &ex) override
+    {
+        if (!ex)
+        {
+            WarnL << "connect failed: " << ex.what();
+        }
+    }
+    void OnRecv(const cyber::Buffer::Ptr &buf) override
+    {
+        auto cb = std::move(on_reply_);
+        on_reply_ = nullptr;
+        if (cb)
+        {
+            cb(buf->ToString());
+        }
+    }
+    void OnError(const cyber::SockException &ex) override
+    {
+        DebugL << ex.what();
+    }
+
+private:
+    std::function<void(const std::string &reply)> on_reply_;
+};
+
+std::atomic<int> EchoClient::s_connections{0};
+
+int main(int argc, char const *argv[])
+{
+    cyber::Logger::Instance().Add(std::make_shared<cyber::ConsoleChannel>());
+    cyber::Logger::Instance().SetWriter(std::make_shared<cyber::AsyncLogWriter>());
+
+    cyber::TCPServer::Ptr server(new cyber::TCPServer());
+    server->Start<EchoSession>(16557);
+
+    // 8 request chains, 1000 requests each, over pooled connections
+    auto pool = cyber::UpstreamPool<EchoClient>::Create("127.0.0.1", 16557);
+    static cyber::Semaphore sem;
+    static std::atomic<int> done{0}, failed{0};
+    const int chains = 8, requests = 1000;
+
+    std::function<void(int)> next = [&](int left)
+    {
+        if (!left)
+        {
+            if (++done == chains)
+            {
+                sem.Post();
+            }
+            return;
+        }
+        pool->Acquire([&, left](const cyber::SockException &ex, const EchoClient::Ptr &client)
+                      {
+                          if (!ex)
+                          {
+                              ++failed;
+                              next(left - 1);
+                              return;
+                          }
+                          client->Request("ping", [&, left, client](const std::string &reply)
+                                          {
+                                              if (reply != "ping")
+                                              {
+                                                  ++failed;
+                                              }
+                                              pool->Release(client);
+                                              next(left - 1);
+                                          });
+                      });
+    };
+
+    cyber::Ticker ticker;
+    auto poller = cyber::EventPollerPool::Instance().GetPoller();
+    for (int i = 0; i < chains; ++i)
+    {
+        poller->Async([&]()
+                      { next(requests); });
+    }
+    sem.Wait();
+    InfoL << chains * requests << " requests in " << ticker.EleapsedTime() << "ms over "
+          << EchoClient::s_connections << " connections, " << failed << " failed";
+
+    signal(SIGINT, [](int)
+           { sem.Post(); });
+    sem.Wait();
+    return 0;
+}
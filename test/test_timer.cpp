@@ -1,10 +1,10 @@
 #include <signal.h>
 
-#include "../Cyber/util.h"
-#include "../Cyber/logger.h"
-#include "../Cyber/time_ticker.h"
-#include "../Cyber/Timer.h"
-#include "../Cyber/semaphore.h"
+#include "../Cyber/Util/util.h"
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Util/time_ticker.h"
+#include "../Cyber/Poller/Timer.h"
+#include "../Cyber/Thread/semaphore.h"
 
 int main(int argc, char const *argv[])
 {
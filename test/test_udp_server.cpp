@@ -0,0 +1,92 @@
+#include <unistd.h>
+#include <signal.h>
+#include <arpa/inet.h>
+
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Socket/udp_server.h"
+#include "../Cyber/Socket/sock.h"
+#include "../Cyber/Util/time_ticker.h"
+
+class EchoSession : public cyber::UDPSession
+{
+public:
+    EchoSession(const cyber::Socket::Ptr &sock) : cyber::UDPSession(sock) {}
+    ~EchoSession()
+    {
+        DebugL << "peer gone after " << count_ << " datagrams";
+    }
+    virtual void OnRecv(const cyber::Buffer::Ptr &buf) override
+    {
+        ++count_;
+        Send(buf);
+    }
+    virtual void OnError(const cyber::SockException &err) override
+    {
+        WarnL << err.what();
+    }
+    virtual void OnManager() override {}
+
+private:
+    size_t count_ = 0;
+};
+
+int main(int argc, char const *argv[])
+{
+    cyber::Logger::Instance().Add(std::make_shared<cyber::ConsoleChannel>());
+    cyber::Logger::Instance().SetWriter(std::make_shared<cyber::AsyncLogWriter>());
+
+    cyber::UDPServer::Ptr server(new cyber::UDPServer());
+    server->SetSessionTimeout(5);
+    server->SetUdpOffload(true, true);
+    server->Start<EchoSession>(16556);
+
+    // a client on its own poller sends a burst and counts the echoes
+    const int total = 10000;
+    auto poller = cyber::EventPollerPool::Instance().GetPoller();
+    auto client = cyber::Socket::CreateSocket(poller, false);
+    client->BindUdpSock(0, "0.0.0.0", false);
+    client->EnableUdpGso();
+
+    static std::atomic<int> echoed{0};
+    static cyber::Semaphore sem;
+    client->SetOnRead([](const cyber::Buffer::Ptr &buf, sockaddr *addr, int addr_len)
+                      {
+                          if (++echoed == total)
+                          {
+                              sem.Post();
+                          }
+                      });
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(server->GetPort());
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    // 64 datagrams a millisecond, a burst of all of them would overflow the receive buffers
+    cyber::Ticker ticker;
+    static int sent = 0;
+    poller->DoDelayTask(1, [client, addr]()
+                        {
+                            std::string payload(512, 'x');
+                            for (int i = 0; i < 64 && sent < total; ++i, ++sent)
+                            {
+                                client->Send(payload, (sockaddr *)&addr, sizeof(addr));
+                            }
+                            return sent < total ? 1 : 0;
+                        });
+
+    // udp may drop, stop waiting after a while
+    poller->DoDelayTask(5000, []()
+                        {
+                            sem.Post();
+                            return 0;
+                        });
+    sem.Wait();
+    InfoL << echoed << " of " << total << " datagrams echoed in " << ticker.EleapsedTime() << "ms";
+
+    signal(SIGINT, [](int)
+           { sem.Post(); });
+    sem.Wait();
+    return 0;
+}
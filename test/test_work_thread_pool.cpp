@@ -0,0 +1,92 @@
+#include <signal.h>
+#include <atomic>
+#include "../Cyber/Util/logger.h"
+#include "../Cyber/Util/time_ticker.h"
+#include "../Cyber/Poller/poller.h"
+#include "../Cyber/Thread/work_thread_pool.h"
+
+#define JOB_COUNT 64
+#define SPLIT 8
+
+// cpu bound stand-in for hashing/compression
+static uint64_t Crunch(uint64_t seed)
+{
+    uint64_t hash = seed;
+    for (int i = 0; i < 2000000; ++i)
+    {
+        hash = (hash ^ (uint64_t)i) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int main(int argc, char const *argv[])
+{
+    cyber::Logger::Instance().Add(std::make_shared<cyber::ConsoleChannel>());
+    cyber::Logger::Instance().SetWriter(std::make_shared<cyber::AsyncLogWriter>());
+
+    auto poller = cyber::EventPollerPool::Instance().GetPoller();
+    auto &pool = cyber::WorkThreadPool::Instance();
+    static cyber::Semaphore sem;
+
+    // the poller keeps a 10ms timer while the work runs, how late it fires shows whether the loop stayed free
+    std::atomic<uint64_t> max_late{0};
+    cyber::Ticker timer_ticker;
+    auto timer = poller->DoDelayTask(10, [&]()
+                                     {
+                                         uint64_t late = timer_ticker.EleapsedTime() > 10 ? timer_ticker.EleapsedTime() - 10 : 0;
+                                         if (late > max_late)
+                                         {
+                                             max_late = late;
+                                         }
+                                         timer_ticker.ResetTime();
+                                         return 10;
+                                     });
+
+    cyber::Ticker ticker;
+    poller->Async([&]()
+                  {
+                      auto done = std::make_shared<int>(0);
+                      auto sum = std::make_shared<uint64_t>(0);
+                      for (int i = 0; i < JOB_COUNT; ++i)
+                      {
+                          // each job forks SPLIT pieces from inside the pool, idle workers steal them;
+                          // the last piece to finish hands the job's result back to the poller
+                          pool.AsyncThen(
+                              [&pool, poller, done, sum, i]()
+                              {
+                                  auto parts = std::make_shared<std::atomic<uint64_t>>(0);
+                                  auto left = std::make_shared<std::atomic<int>>(SPLIT);
+                                  for (int j = 0; j < SPLIT; ++j)
+                                  {
+                                      pool.AsyncThen(
+                                          [=]()
+                                          {
+                                              *parts += Crunch(i * SPLIT + j);
+                                              return --*left == 0;
+                                          },
+                                          [=](bool last)
+                                          {
+                                              // back on the poller
+                                              if (!last)
+                                              {
+                                                  return;
+                                              }
+                                              *sum += parts->load();
+                                              if (++*done == JOB_COUNT)
+                                              {
+                                                  InfoL << "checksum " << *sum;
+                                                  sem.Post();
+                                              }
+                                          },
+                                          poller);
+                                  }
+                              },
+                              []() {});
+                      }
+                  });
+    sem.Wait();
+    timer->Cancel();
+    InfoL << JOB_COUNT * SPLIT << " pieces on " << pool.GetExecutorLoad().size() << " workers in " << ticker.EleapsedTime()
+          << "ms, poller timer at most " << max_late << "ms late";
+    return 0;
+}